@@ -0,0 +1,79 @@
+#ifndef __ACTIVEWINDOW_H_CMC__
+#define __ACTIVEWINDOW_H_CMC__
+#include "itensor/all.h"
+using namespace itensor;
+using namespace std;
+
+// Active window of sites [first,last] for TDVPWorker and addBasis (Args "ActiveFirst" and "ActiveLast").
+// The sites outside the window are frozen: TDVP does not visit them, their environments in LocalMPO are reused,
+// and the subspace expansion does not enlarge their bonds.
+//
+// After each time step the window is set from the densities and bond entropies measured by TDVPObserver.
+// A site is active if its density changed by more than tol_den since the last update,
+// or if one of its bonds has entanglement entropy above tol_S. The pinned sites (scatterer and charge site) are always active.
+// The window is the range of the active sites widened by <margin> sites on each side.
+// The frozen sites are not measured, so the window grows only from its edges, when the sites there start to change.
+class ActiveWindow
+{
+    public:
+        ActiveWindow () {}
+        ActiveWindow (int N, const vector<int>& pinned, Real tol_den, Real tol_S, int margin)
+        : _N (N)
+        , _first (1)
+        , _last (N)
+        , _pinned (pinned)
+        , _tol_den (tol_den)
+        , _tol_S (tol_S)
+        , _margin (margin)
+        {}
+
+        // ns: densities (0-index by site), Ss: bond entropies (1-index by bond)
+        void update (const vector<Real>& ns, const vector<Real>& Ss)
+        {
+            mycheck (ns.size() == _N, "size not match");
+            int lo = _N+1, hi = 0;
+            auto mark = [&lo, &hi] (int i) { lo = min (lo, i); hi = max (hi, i); };
+            for(int i : _pinned)
+                mark (i);
+            for(int i = 1; i <= _N; i++)
+            {
+                bool changed = (_ns_prev.size() == _N and abs (ns.at(i-1) - _ns_prev.at(i-1)) > _tol_den);
+                bool entangled = (i > 1 and Ss.at(i-1) > _tol_S) or (i < _N and Ss.at(i) > _tol_S);
+                if (changed or entangled)
+                    mark (i);
+            }
+            _ns_prev = ns;
+            if (hi == 0)
+                lo = hi = 1;
+            _first = max (1, lo - _margin);
+            _last  = min (_N, hi + _margin);
+            // At least two sites for the two-site update
+            if (_last == _first)
+            {
+                if (_last < _N) _last++;
+                else            _first--;
+            }
+        }
+
+        // After the sites have been reordered
+        void reset (const vector<int>& pinned)
+        {
+            _pinned = pinned;
+            _first = 1;
+            _last = _N;
+            _ns_prev.clear();
+        }
+
+        int  first () const { return _first; }
+        int  last  () const { return _last; }
+        Args args  () const { return {"ActiveFirst",_first,"ActiveLast",_last}; }
+        Real frozen_fraction () const { return 1. - Real(_last-_first+1) / _N; }
+
+    private:
+        int          _N=0, _first=1, _last=0;
+        vector<int>  _pinned;
+        Real         _tol_den=0., _tol_S=0.;
+        int          _margin=0;
+        vector<Real> _ns_prev;
+};
+#endif
@@ -0,0 +1,155 @@
+#ifndef __BATCHEXPECT_H_CMC__
+#define __BATCHEXPECT_H_CMC__
+#include <thread>
+#include <atomic>
+#include "itensor/all.h"
+using namespace itensor;
+using namespace std;
+
+// Expectation values <psi|O|psi> of many MPOs on the same sites, computed together.
+//
+// An MPO is the identity on the sites before its first nontrivial site <first> and after its last one <last>,
+// up to a single state of the link, which add() finds from the tensors. Its left environment at <first> is then
+// the overlap environment of psi times that link state; the overlap environments are built once and shared by all MPOs,
+// and are the identity on the left-orthonormal sites. If the sites after <last> are right-orthonormal,
+// the right environment is the identity as well and the contraction stops at <last>.
+// The bra tensors are also prepared once, and the MPOs are distributed over <nthreads> threads.
+
+// Tensor T with op * T = Tr(op) for the operators on the site index s
+ITensor trace_tensor (const Index& s)
+{
+    ITensor T (s, dag(prime(s)));
+    for(int n = 1; n <= dim(s); n++)
+        T.set (s=n, dag(prime(s))=n, 1.);
+    return T;
+}
+
+// If W = u * Id on the site index s, for a tensor u on the links of W, set u and return true
+bool split_identity (const ITensor& W, const Index& s, ITensor& u)
+{
+    auto T = trace_tensor (s);
+    u = W * T / Real(dim(s));
+    auto R = W - u * dag(T);
+    return norm(R) <= 1e-12 * norm(W);
+}
+
+class BatchExpect
+{
+    public:
+        // Add or replace the MPO <name>
+        void add (const string& name, const MPO& mpo);
+        void clear () { _terms.clear(); }
+        int  size  () const { return _terms.size(); }
+
+        map<string,Cplx> compute (const MPS& psi, int nthreads=1) const;
+
+    private:
+        struct Term
+        {
+            string  name;
+            MPO     mpo;
+            int     first, last;
+            ITensor vl, vr;     // link states of the identity parts, on the left link of <first> and the right link of <last>
+        };
+        vector<Term> _terms;
+};
+
+void BatchExpect :: add (const string& name, const MPO& mpo)
+{
+    int N = length(mpo);
+    Term t {name, mpo, 1, N, ITensor(1.), ITensor(1.)};
+
+    ITensor v (1.);
+    for(int j = 1; j < N; j++)
+    {
+        ITensor u;
+        if (!split_identity (v * mpo(j), findIndex (mpo(j), "Site,0"), u))
+            break;
+        v = u;
+        t.first = j+1;
+        t.vl = v;
+    }
+    v = ITensor(1.);
+    for(int j = N; j > t.first; j--)
+    {
+        ITensor u;
+        if (!split_identity (mpo(j) * v, findIndex (mpo(j), "Site,0"), u))
+            break;
+        v = u;
+        t.last = j-1;
+        t.vr = v;
+    }
+
+    for(auto& term : _terms)
+        if (term.name == name)
+        {
+            term = t;
+            return;
+        }
+    _terms.push_back (t);
+}
+
+map<string,Cplx> BatchExpect :: compute (const MPS& psi, int nthreads) const
+{
+    int N = length(psi);
+    vector<ITensor> bras (N+1);
+    for(int j = 1; j <= N; j++)
+        bras.at(j) = dag (prime (psi(j)));
+
+    // Overlap environments; Ls[j] contains the sites 1,...,j
+    int max_first = 1;
+    for(auto const& t : _terms)
+        max_first = max (max_first, t.first);
+    vector<ITensor> Ls (max_first);
+    for(int j = 1; j < max_first; j++)
+    {
+        auto l = rightLinkIndex (psi,j);
+        if (j <= leftLim(psi))
+            Ls.at(j) = delta (l, dag(prime(l)));
+        else
+        {
+            auto bra = dag (prime (psi(j), "Link"));
+            Ls.at(j) = (j == 1 ? psi(j) * bra : Ls.at(j-1) * psi(j) * bra);
+        }
+    }
+
+    auto contract = [&] (const Term& t)
+    {
+        int last = (rightLim(psi) <= t.last+1 ? t.last : N);
+        ITensor E = (t.first == 1 ? t.vl : Ls.at(t.first-1) * t.vl);
+        for(int j = t.first; j <= last; j++)
+        {
+            E *= psi(j);
+            E *= t.mpo(j);
+            E *= bras.at(j);
+        }
+        if (last < N)
+        {
+            auto l = rightLinkIndex (psi,last);
+            E *= t.vr;
+            E *= delta (dag(l), prime(l));
+        }
+        return eltC(E);
+    };
+
+    // The MPOs are handed out one by one, since their ranges differ
+    vector<Cplx> vals (_terms.size());
+    std::atomic<int> next (0);
+    auto work = [&] ()
+    {
+        for(int n = next++; n < _terms.size(); n = next++)
+            vals.at(n) = contract (_terms.at(n));
+    };
+    vector<std::thread> threads;
+    for(int i = 1; i < nthreads; i++)
+        threads.emplace_back (work);
+    work ();
+    for(auto& th : threads)
+        th.join();
+
+    map<string,Cplx> re;
+    for(int n = 0; n < _terms.size(); n++)
+        re[_terms.at(n).name] = vals.at(n);
+    return re;
+}
+#endif
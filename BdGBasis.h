@@ -2,84 +2,91 @@
 #define __BDGBASIS_H_CMC__
 #include "itensor/all.h"
 #include "ReadWriteFile.h"
+#include <random>
+#include "COpTable.h"
 using namespace itensor;
 using namespace std;
 
-Matrix BdG_Hamilt (int L, Real t, Real mu, Real Delta)
+// Blocks of the BdG Hamiltonian of a Kitaev chain in the basis (Cdag_1,...,Cdag_L, C_1,...,C_L)
+//
+//   H = (1/2) [  h  B ]      h is symmetric and B is antisymmetric, both tridiagonal:
+//             [ -B -h ]      h(i,i) = -mu, h(i,i+1) = -t, B(i,i+1) = -Delta
+//
+// Only the diagonals are stored: hd (L), he (L-1) and Be (L-1)
+struct BdGBlocks
+{
+    vector<Real> hd, he, Be;
+};
+
+BdGBlocks BdG_blocks (int L, Real t, Real mu, Real Delta)
+{
+    BdGBlocks blk;
+    blk.hd = vector<Real> (L, -mu);
+    blk.he = vector<Real> (max(L-1,0), -t);
+    blk.Be = vector<Real> (max(L-1,0), -Delta);
+    return blk;
+}
+
+// Dense 2L x 2L BdG Hamiltonian
+Matrix BdG_Hamilt (const BdGBlocks& blk)
 {
-    int N = 2*L;
-    Matrix H (N,N);
-    for(int ip = 0; ip < N; ip++)
-        for(int jp = 0; jp < N; jp++)
+    int L = blk.hd.size();
+    Matrix H (2*L,2*L);
+    for(int i = 0; i < L; i++)
+    {
+        H(i,i)     = blk.hd.at(i);
+        H(i+L,i+L) = -blk.hd.at(i);
+        if (i < L-1)
         {
-            int i = ip+1,
-                j = jp+1;
-            bool dagi = true,
-                 dagj = false;
-            if (i > L)
-            {
-                i -= L;
-                dagi = false;
-            }
-            if (j > L)
-            {
-                j -= L;
-                dagj = true;
-            }
-
-            // mu
-            if (i == j)
-            {
-                if (dagi != dagj)
-                {
-                    if (dagi)
-                        H(ip,jp) = -mu;
-                    else
-                        H(ip,jp) = mu;
-                }
-            }
-            if (abs(i-j) == 1)
-            {
-                // t
-                if (dagi != dagj)
-                {
-                    if (dagi)
-                        H(ip,jp) = -t;
-                    else
-                        H(ip,jp) = t;
-                }
-                // Delta
-                else
-                {
-                    if (dagi == (i > j))
-                        H(ip,jp) = Delta;
-                    else
-                        H(ip,jp) = -Delta;
-                }
-            }
+            H(i,i+1)     = H(i+1,i)     = blk.he.at(i);
+            H(i+L,i+1+L) = H(i+1+L,i+L) = -blk.he.at(i);
+            // B(i,i+1) = Be, B(i+1,i) = -Be
+            H(i,i+1+L)   =  blk.Be.at(i);
+            H(i+1,i+L)   = -blk.Be.at(i);
+            H(i+L,i+1)   = -blk.Be.at(i);
+            H(i+1+L,i)   =  blk.Be.at(i);
         }
+    }
     return 0.5*H;
 }
 
+Matrix BdG_Hamilt (int L, Real t, Real mu, Real Delta)
+{
+    return BdG_Hamilt (BdG_blocks (L,t,mu,Delta));
+}
+
 // Use only the positive-energy states, ordering from lowest to highest energy
 class BdGBasis
 {
     public:
         BdGBasis () {}
-        BdGBasis (const string& name, int L, Real t, Real mu, Real Delta);
+        // verify_samples: number of randomly chosen modes checked against H after the construction;
+        //                 0 for no check, -1 for the full dense check of the unitary matrix
+        BdGBasis (const string& name, int L, Real t, Real mu, Real Delta, int verify_samples=10);
+        // The same chain in real space: the modes are the sites (u = 1, v = 0, en = -mu),
+        // and the hopping and the pairing are given by offdiag_terms and pairing_terms
+        static BdGBasis real_space (const string& name, int L, Real t, Real mu, Real Delta);
 
         tuple<vector<Real>,vector<int>,vector<string>> C (int i);
 
         // Functions that every basis class must have
         const string&                name     ()                const { return _name; }
-        vector<tuple<int,auto,bool>> C_op     (int i, bool dag) const;
+        COpRow<Real>                 C_op     (int i, bool dag) const { return _C_table.row (i, dag); }
         vector<tuple<int,auto,bool>> gamma_op (int k, bool dag) const;
         // en(i) is the energy in H_BdG = sum_i^N { en(i) gamma_i^dag gamma_i } - sum_i^N { (1/2) en(i) }
         Real                         en       (int k)           const { return _ens(k-1); }
-        Real                         mu       (int k)           const { mycheck (k <= this->size(), "Out of range"); return -2. * _H(k-1,k-1); }
+        Real                         mu       (int k)           const { mycheck (k <= this->size(), "Out of range"); return -2. * Hdiag(k-1); }
         int                          size     ()                const { return _ens.size(); }
-        auto const&                  H        ()                const { return _H; }
-        auto const&                  H        (int i, int j)    const { return _H(i,j); }
+        // Number of real-space sites; negative site indices count from here
+        int                          n_sites  ()                const { return _ens.size(); }
+        // Diagonal element H(i,i) of the BdG Hamiltonian, i < N (0-index)
+        Real                         Hdiag    (int i)           const { return 0.5 * _blk.hd.at(i); }
+        const BdGBlocks&             blocks   ()                const { return _blk; }
+        bool                         is_real_space ()           const { return _real_space; }
+
+        // (k1, k2, h) for h Cdag_k1 C_k2, and (k1, k2, B) for B Cdag_k1 Cdag_k2 - B C_k1 C_k2; only in real space
+        vector<tuple<int,int,Real>>  offdiag_terms () const;
+        vector<tuple<int,int,Real>>  pairing_terms () const;
 
         void write (ostream& s) const
         {
@@ -87,7 +94,10 @@ class BdGBasis
             itensor::write(s,_u);
             itensor::write(s,_v);
             itensor::write(s,_ens);
-            itensor::write(s,_H);
+            itensor::write(s,_blk.hd);
+            itensor::write(s,_blk.he);
+            itensor::write(s,_blk.Be);
+            itensor::write(s,_real_space);
         }
         void read (istream& s)
         {
@@ -95,13 +105,24 @@ class BdGBasis
             itensor::read(s,_u);
             itensor::read(s,_v);
             itensor::read(s,_ens);
-            itensor::read(s,_H);
+            itensor::read(s,_blk.hd);
+            itensor::read(s,_blk.he);
+            itensor::read(s,_blk.Be);
+            itensor::read(s,_real_space);
+            make_C_table ();
         }
 
     private:
-        string _name;
-        Vector _ens;
-        Matrix _u, _v, _H;
+        void make_C_table ();
+        void verify_full ()               const;
+        void verify_sampled (int nsample) const;
+
+        string    _name;
+        Vector    _ens;
+        Matrix    _u, _v;
+        BdGBlocks _blk;
+        bool      _real_space = false;
+        COpTable<Real> _C_table;
 };
 
 Vector particle_hole_transform (const Vector& v)
@@ -205,57 +226,111 @@ void check_orthogonal_to_particle_hole_transform (const Vector& v)
     }
 }
 
-BdGBasis :: BdGBasis (const string& name, int L, Real t, Real mu, Real Delta)
+// The BdG eigenproblem  [  h  B ] [u]  = E [u]
+//                       [ -B -h ] [v]      [v]
+// is reduced to an N x N singular value decomposition. With phi = u+v and psi = u-v,
+//      (h+B) phi = E psi,   (h+B)^T psi = E phi,
+// so E are the singular values of M = h+B, and phi, psi are the right and left singular vectors.
+// The zero-energy (Majorana) modes come out as particle-hole partners automatically,
+// since (phi,psi) and (phi,-psi) are orthogonal.
+BdGBasis :: BdGBasis (const string& name, int L, Real t, Real mu, Real Delta, int verify_samples)
 : _name (name)
+, _blk (BdG_blocks (L,t,mu,Delta))
 {
-    _H = BdG_Hamilt (L,t,mu,Delta);
-    Matrix U;
-    Vector ens;
-    diagHermitian (_H, U, ens);
-    // ens(q) for q=0,1,...,2N-1 is the energy in descending order (highest to lowest).
-    // The energy for q=0,...N-1 is positive
-    //                q=N,...2N-1 is negative
-
-    U = symmetrice_zero_energy_modes (ens, U);
-
-    auto tmp = U(0,0);
-    if constexpr (!is_same_v <decltype(tmp), Real>)
+    int N = L;
+    Matrix M (N,N);
+    for(int i = 0; i < N; i++)
     {
-        cout << "The current version is only for unitary matrix of Real type" << endl;
-        cout << "Type found is: " << typeid(tmp).name() << endl;
-        throw;
+        M(i,i) = _blk.hd.at(i);
+        if (i < N-1)
+        {
+            M(i,i+1) = _blk.he.at(i) + _blk.Be.at(i);
+            M(i+1,i) = _blk.he.at(i) - _blk.Be.at(i);
+        }
     }
+    Matrix Psi, Phi;
+    Vector sv;
+    SVD (M, Psi, sv, Phi);       // M = Psi * sv * Phi^T, sv in descending order
 
     // _ens are for the positive energies in ascending order (lowest to highest)
     //  U = [ _u  _v* ] is the unitrary matrix to diagonalize H
     //      [ _v  _u* ]
-    // Take only the positive-energy states, i.e. the first N columns, to define _u and _v.
-    int N = ens.size()/2;
     _ens = Vector (N);
     _u = Matrix (N,N);
     _v = Matrix (N,N);
-    int j = 0;
-    for(int i = N-1; i >= 0; i--)
+    for(int k = 0; k < N; k++)
+    {
+        int q = N-1-k;
+        _ens(k) = sv(q);
+        for(int i = 0; i < N; i++)
+        {
+            _u(i,k) = 0.5 * (Phi(i,q) + Psi(i,q));
+            _v(i,k) = 0.5 * (Phi(i,q) - Psi(i,q));
+        }
+    }
+
+    if (verify_samples < 0)
+        verify_full ();
+    else if (verify_samples > 0)
+        verify_sampled (verify_samples);
+
+    make_C_table ();
+}
+
+BdGBasis BdGBasis :: real_space (const string& name, int L, Real t, Real mu, Real Delta)
+{
+    BdGBasis b;
+    b._name = name;
+    b._blk = BdG_blocks (L,t,mu,Delta);
+    b._real_space = true;
+    b._ens = Vector (L);
+    b._u = Matrix (L,L);
+    b._v = Matrix (L,L);
+    for(int i = 0; i < L; i++)
     {
-        // Check the state is orthogonal to its particle-hole transformed state
-        auto phi = Vector (column (U, i));
-        //check_orthogonal_to_particle_hole_transform (phi);
-
-        _ens(j) = 2.*ens(i);
-        column (_u,j) &= subVector (phi,0,N);
-        column (_v,j) &= subVector (phi,N,2*N);
-        j++;
+        b._ens(i) = b._blk.hd.at(i);
+        b._u(i,i) = 1.;
     }
+    b.make_C_table ();
+    return b;
+}
 
-    // Check the unitrary matrices U = [ u  v* ]
-    //                                 [ v  u* ]
+vector<tuple<int,int,Real>> BdGBasis :: offdiag_terms () const
+{
+    vector<tuple<int,int,Real>> terms;
+    if (_real_space)
+        for(int i = 0; i < _blk.he.size(); i++)
+        {
+            terms.emplace_back (i+1, i+2, _blk.he.at(i));
+            terms.emplace_back (i+2, i+1, _blk.he.at(i));
+        }
+    return terms;
+}
+
+// From (1/2) [ Cdag B Cdag - C B C ] with B(i,i+1) = -B(i+1,i) = Be
+vector<tuple<int,int,Real>> BdGBasis :: pairing_terms () const
+{
+    vector<tuple<int,int,Real>> terms;
+    if (_real_space)
+        for(int i = 0; i < _blk.Be.size(); i++)
+            terms.emplace_back (i+1, i+2, _blk.Be.at(i));
+    return terms;
+}
+
+// Check the unitrary matrices U = [ u  v* ]
+//                                 [ v  u* ]
+// with dense O(N^3) products
+void BdGBasis :: verify_full () const
+{
+    int N = _ens.size();
+    auto H = BdG_Hamilt (_blk);
     Matrix Uc (2*N, 2*N);
     subMatrix(Uc,0,N,0,N)     &= _u;
     subMatrix(Uc,N,2*N,0,N)   &= _v;
     subMatrix(Uc,0,N,N,2*N)   &= conj (_v);
     subMatrix(Uc,N,2*N,N,2*N) &= conj (_u);
 
-    auto Hd = transpose(Uc) * _H * Uc;
+    auto Hd = transpose(Uc) * H * Uc;
     for(int i = 0; i < N; i++)
     {
         Hd(i,i) -= 0.5*_ens(i);
@@ -264,41 +339,79 @@ BdGBasis :: BdGBasis (const string& name, int L, Real t, Real mu, Real Delta)
     mycheck (abs(norm(Hd)) < 1e-10, "Construct unitray matrix failed");
 }
 
+// Check randomly chosen modes k in O(N) each, using the tridiagonal blocks:
+//      the residual |H (u_k,v_k) - (E_k/2) (u_k,v_k)|,
+//      the normalization, and the orthogonality to another sampled mode and to its particle-hole partner
+void BdGBasis :: verify_sampled (int nsample) const
+{
+    int N = _ens.size();
+    auto const& hd = _blk.hd;
+    auto const& he = _blk.he;
+    auto const& Be = _blk.Be;
+    auto h_times = [&] (const Matrix& x, int k, int i)  // (h x_k)(i)
+    {
+        Real re = hd.at(i) * x(i,k);
+        if (i > 0)   re += he.at(i-1) * x(i-1,k);
+        if (i < N-1) re += he.at(i)   * x(i+1,k);
+        return re;
+    };
+    auto B_times = [&] (const Matrix& x, int k, int i)  // (B x_k)(i)
+    {
+        Real re = 0.;
+        if (i > 0)   re -= Be.at(i-1) * x(i-1,k);
+        if (i < N-1) re += Be.at(i)   * x(i+1,k);
+        return re;
+    };
+
+    std::mt19937 gen (N);
+    std::uniform_int_distribution<int> dist (0, N-1);
+    Real max_err = 0.;
+    for(int s = 0; s < nsample; s++)
+    {
+        int k = dist (gen),
+            l = dist (gen);
+        Real res2 = 0., nrm = 0., ovl = 0., ovl_ph = 0.;
+        for(int i = 0; i < N; i++)
+        {
+            Real r1 = 0.5 * ( h_times (_u,k,i) + B_times (_v,k,i)) - 0.5*_ens(k) * _u(i,k);
+            Real r2 = 0.5 * (-B_times (_u,k,i) - h_times (_v,k,i)) - 0.5*_ens(k) * _v(i,k);
+            res2 += r1*r1 + r2*r2;
+            nrm += _u(i,k)*_u(i,k) + _v(i,k)*_v(i,k);
+            if (l != k)
+                ovl += _u(i,k)*_u(i,l) + _v(i,k)*_v(i,l);
+            ovl_ph += _u(i,k)*_v(i,l) + _v(i,k)*_u(i,l);
+        }
+        max_err = max ({max_err, sqrt(res2), abs(nrm-1.), abs(ovl), abs(ovl_ph)});
+    }
+    mycheck (max_err < 1e-10, "Construct unitray matrix failed");
+}
+
 // i is the site index in real space
-// Return k, coef, dagger
+// Store k, coef, dagger for every i
 //
 // [ C    ]  = [ u v* ] [ gamma     ]
 // [ Cdag ]    [ v u* ] [ gamma^dag ]
 //
 // C_i = sum_k^N { u(i,k) gamma + v*(i,k) gamma^dag }
-vector<tuple<int,auto,bool>> BdGBasis :: C_op (int i, bool dag) const
+// The row for Cdag_i is the conjugate with the daggers flipped.
+void BdGBasis :: make_C_table ()
 {
-    int N = _ens.size(); 
-    mycheck (i >= 1 and i <= N, "out of range");     // i is from 1 to N
-
-    auto tmp = _u(0,0);
-    vector<tuple<int,decltype(tmp),bool>> k_coef_dag;
-    // For C
-    for(int k = 0; k < N; k++)
-    {
-        auto uk = _u(i-1,k);
-        auto vk = _v(i-1,k);
-        if (abs(uk) > 1e-14)
-            k_coef_dag.emplace_back (k+1, uk, false);
-        if (abs(vk) > 1e-14)
-            k_coef_dag.emplace_back (k+1, iut::conj(vk), true);
-    }
-    // If Cdag
-    if (dag)
+    int N = _ens.size();
+    vector<vector<tuple<int,Real,bool>>> rows (N);
+    for(int i = 0; i < N; i++)
     {
-        for(auto& [k, coef, dagk] : k_coef_dag)
+        auto& row = rows.at(i);
+        for(int k = 0; k < N; k++)
         {
-            coef = iut::conj (coef);
-            dagk = !dagk;
+            auto uk = _u(i,k);
+            auto vk = _v(i,k);
+            if (abs(uk) > 1e-14)
+                row.emplace_back (k+1, uk, false);
+            if (abs(vk) > 1e-14)
+                row.emplace_back (k+1, iut::conj(vk), true);
         }
     }
-
-    return k_coef_dag;
+    _C_table = COpTable<Real> (rows, true);
 }
 
 //                                  [ u v* ]
@@ -366,12 +479,13 @@ Real ground_state_energy (const BdGBasis& b)
     Real en = 0.;
     for(int i = 0; i < b.size(); i++)
     {
-        en -= 0.5*b.en(i+1) - b.H(i,i);
+        en -= 0.5*b.en(i+1) - b.Hdiag(i);
     }
     return en;
 }
 
-void print_ops (const vector<tuple<int,auto,bool>>& ops)
+template <typename Ops>
+void print_ops (const Ops& ops)
 {
     cout << "site, coef, dag" << endl;
     for(auto& [k, coef, dagk] : ops)
@@ -0,0 +1,58 @@
+#ifndef __BENCHMARK_H_CMC__
+#define __BENCHMARK_H_CMC__
+#include "itensor/all.h"
+#include "itensor/util/cputime.h"
+using namespace itensor;
+using namespace std;
+
+// Time a TDVP-like sweep (left to right and back) of the effective Hamiltonian for two local operators,
+// e.g. LocalMPO with one MPO and LocalMPOSet with a set of MPOs for the same Hamiltonian.
+// At every site the environment update (position) and nrep products are timed together, since a set of MPOs
+// pays one environment update per MPO. The gauge of psi is moved untimed, as it is common to both.
+// Return the total wall times and print them, split into environments and products
+template <typename LocalOpT1, typename LocalOpT2>
+pair<Real,Real> benchmark_local_product (MPS psi, LocalOpT1& PH1, LocalOpT2& PH2, int nrep=3,
+                                         const string& name1="H", const string& name2="Hset")
+{
+    int N = length(psi);
+    psi.position(1);
+    PH1.numCenter(1);
+    PH2.numCenter(1);
+
+    Real env1 = 0., env2 = 0., prod1 = 0., prod2 = 0.;
+    Real max_diff = 0.;
+    vector<int> bs;
+    for(int b = 1; b <= N; b++)  bs.push_back (b);
+    for(int b = N-1; b >= 1; b--) bs.push_back (b);
+    for(int b : bs)
+    {
+        psi.position(b);
+        auto phi = psi(b);
+        ITensor Hphi1, Hphi2;
+
+        cpu_time time1;
+        PH1.position(b,psi);
+        env1 += time1.sincemark().wall;
+        cpu_time ptime1;
+        for(int r = 0; r < nrep; r++)
+            PH1.product (phi, Hphi1);
+        prod1 += ptime1.sincemark().wall;
+
+        cpu_time time2;
+        PH2.position(b,psi);
+        env2 += time2.sincemark().wall;
+        cpu_time ptime2;
+        for(int r = 0; r < nrep; r++)
+            PH2.product (phi, Hphi2);
+        prod2 += ptime2.sincemark().wall;
+
+        // Both must represent the same Hamiltonian
+        max_diff = max (max_diff, norm (Hphi1 - Hphi2));
+    }
+    cout << "Benchmark effective H, one sweep (environments + " << nrep << " products per site)" << endl;
+    cout << "\t" << name1 << ": " << env1+prod1 << " s (environments " << env1 << ", products " << prod1 << ")" << endl;
+    cout << "\t" << name2 << ": " << env2+prod2 << " s (environments " << env2 << ", products " << prod2 << ")" << endl;
+    cout << "\tmax |H1 phi - H2 phi| = " << max_diff << endl;
+    return {env1+prod1, env2+prod2};
+}
+#endif
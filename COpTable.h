@@ -0,0 +1,109 @@
+#ifndef __COPTABLE_H_CMC__
+#define __COPTABLE_H_CMC__
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include "itensor/all.h"
+#include "GeneralUtility.h"
+using namespace std;
+
+// Read-only view of one row of a COpTable: the terms (k, coef, dag) of C_i or Cdag_i.
+// The terms are returned by value, so that a row for Cdag_i can share the storage of the row for C_i
+// and only set the daggers (set_dag).
+template <typename T>
+class COpRow
+{
+    public:
+        using Term = tuple<int,T,bool>;
+
+        class Iter
+        {
+            public:
+                Iter (const Term* p, bool set_dag) : _p (p), _set_dag (set_dag) {}
+                Term  operator*  () const { return term (*_p, _set_dag); }
+                Iter& operator++ () { ++_p; return *this; }
+                bool  operator!= (const Iter& it) const { return _p != it._p; }
+            private:
+                const Term* _p;
+                bool        _set_dag;
+        };
+
+        COpRow () {}
+        COpRow (const Term* first, const Term* last, bool set_dag=false) : _first (first), _last (last), _set_dag (set_dag) {}
+
+        Iter begin () const { return Iter (_first, _set_dag); }
+        Iter end   () const { return Iter (_last, _set_dag); }
+        int  size  () const { return _last - _first; }
+        bool empty () const { return _first == _last; }
+        Term operator[] (int j) const { return term (_first[j], _set_dag); }
+
+    private:
+        const Term* _first = nullptr;
+        const Term* _last  = nullptr;
+        bool        _set_dag = false;
+
+        static Term term (Term t, bool set_dag)
+        {
+            if (set_dag)
+                get<2>(t) = true;
+            return t;
+        }
+};
+
+// Compressed-row table of the expansion of the real-space operators in a basis:
+//   row (i,dag) contains the terms (k, coef, dag') of C(i,dag) = sum_k coef C(k,dag')
+// Rows are sorted by |coef| in descending order, so that a loop can stop at the first term below a cutoff.
+// The table is built once when the basis is constructed; C_op only returns a view to a row.
+template <typename T>
+class COpTable
+{
+    public:
+        using Term = tuple<int,T,bool>;
+
+        COpTable () {}
+
+        // <rows_C[i-1]> are the terms for C_i (without dagger). With <flip_dag> the rows for Cdag_i are stored,
+        // with the coefficients conjugated and the daggers flipped. Otherwise the rows for Cdag_i are those for C_i
+        // with the daggers set to true (OneParticleBasis uses the same coefficients for both), and only the rows for C_i are stored.
+        COpTable (const vector<vector<Term>>& rows_C, bool flip_dag)
+        : _L (rows_C.size())
+        , _shared_dag (!flip_dag)
+        {
+            _offsets.push_back (0);
+            for(int dag = 0; dag <= int(flip_dag); dag++)
+                for(int i = 0; i < _L; i++)
+                {
+                    auto row = rows_C.at(i);
+                    if (dag)
+                        for(auto& [k, coef, dagk] : row)
+                        {
+                            coef = iut::conj (coef);
+                            dagk = !dagk;
+                        }
+                    std::stable_sort (row.begin(), row.end(), [] (const Term& t1, const Term& t2)
+                    {
+                        return abs(get<1>(t1)) > abs(get<1>(t2));
+                    });
+                    _terms.insert (_terms.end(), row.begin(), row.end());
+                    _offsets.push_back (_terms.size());
+                }
+        }
+
+        // i is 1-index
+        COpRow<T> row (int i, bool dag) const
+        {
+            mycheck (i > 0 and i <= _L, "out of range");
+            int r = (dag and !_shared_dag ? _L : 0) + i-1;
+            return COpRow<T> (_terms.data() + _offsets.at(r), _terms.data() + _offsets.at(r+1), dag and _shared_dag);
+        }
+
+        int nrows  () const { return _L; }
+        int nterms () const { return _terms.size(); }
+
+    private:
+        int          _L=0;
+        bool         _shared_dag=false;
+        vector<Term> _terms;
+        vector<int>  _offsets;
+};
+#endif
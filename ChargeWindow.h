@@ -0,0 +1,81 @@
+#ifndef __CHARGEWINDOW_H_CMC__
+#define __CHARGEWINDOW_H_CMC__
+#include "itensor/all.h"
+using namespace itensor;
+using namespace std;
+
+// Adaptive window [lo,hi] of the charge states on the charge site, within [-max_charge,max_charge].
+// It starts narrow around the charges that minimize the charging energy, and after each time step
+// every edge grows by one state if its weight is above tol_grow, or is dropped if its weight is below tol_shrink.
+// The window keeps at least min_width states. An edge that has just grown is not dropped in the next step:
+// its new state starts empty and gets its weight only after the subspace expansion and one time step.
+class ChargeWindow
+{
+    public:
+        ChargeWindow () {}
+        ChargeWindow (int lo, int hi, int max_charge, Real tol_grow, Real tol_shrink, int min_width=2)
+        : _lo (max (lo, -max_charge))
+        , _hi (min (hi, max_charge))
+        , _max (max_charge)
+        , _tol_grow (tol_grow)
+        , _tol_shrink (tol_shrink)
+        , _min_width (min_width)
+        {
+            mycheck (tol_shrink < tol_grow, "tol_shrink must be smaller than tol_grow");
+        }
+
+        // ps: weights of the charge states lo,...,hi. Return true if the window changed.
+        bool update (const vector<Real>& ps)
+        {
+            mycheck (ps.size() == _hi-_lo+1, "size not match");
+            int lo = _lo, hi = _hi;
+            if (ps.front() > _tol_grow and lo > -_max)
+                lo--;
+            else if (ps.front() < _tol_shrink and hi-lo+1 > _min_width and !_grown_lo)
+                lo++;
+            if (ps.back() > _tol_grow and hi < _max)
+                hi++;
+            else if (ps.back() < _tol_shrink and hi-lo+1 > _min_width and !_grown_hi)
+                hi--;
+            _grown_lo = (lo < _lo);
+            _grown_hi = (hi > _hi);
+            bool changed = (lo != _lo or hi != _hi);
+            _lo = lo;
+            _hi = hi;
+            return changed;
+        }
+
+        int lo () const { return _lo; }
+        int hi () const { return _hi; }
+
+    private:
+        int  _lo=0, _hi=0, _max=0;
+        Real _tol_grow=0., _tol_shrink=0.;
+        int  _min_width=2;
+        bool _grown_lo=false, _grown_hi=false;     // the edge grew in the last update
+};
+
+// Replace the index of the charge site ic of psi by s_new, whose first state has the charge new_lo
+// (old_lo for the current index). The amplitudes of the common charges are copied, the dropped charges are discarded,
+// and the new charges start empty. The caller must expand the basis (addBasis) afterwards:
+// the new charges have no QN blocks on the neighbouring bonds, and 1-site TDVP cannot create them.
+// The bonds next to the site are recompressed with <args>, so that their QN blocks follow the new charges.
+void resize_charge_site (MPS& psi, int ic, const Index& s_new, int new_lo, int old_lo, const Args& args)
+{
+    auto s_old = siteIndex (psi, ic);
+    psi.position (ic);
+    ITensor P (dag(s_old), s_new);
+    for(int i = 1; i <= dim(s_old); i++)
+    {
+        int j = old_lo + i - new_lo;
+        if (j >= 1 and j <= dim(s_new))
+            P.set (dag(s_old)=i, s_new=j, 1.);
+    }
+    psi.ref(ic) = psi(ic) * P;
+    psi.normalize();
+
+    int N = length(psi);
+    psi.position (min (ic+1, N), args);
+    psi.position (max (ic-1, 1), args);
+}
+#endif
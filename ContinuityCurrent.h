@@ -0,0 +1,58 @@
+#ifndef __CONTINUITYCURRENT_H_CMC__
+#define __CONTINUITYCURRENT_H_CMC__
+#include <deque>
+#include "itensor/all.h"
+#include "SortBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Rates of change dN/dt of the charges of the partitions <parts>, from the densities measured by TDVPObserver.
+// The charge of a partition is the sum of the densities of its orbitals, found from to_loc, so no contraction is needed.
+// The rate at the step before the last one is the central difference of the charges one step before and after it,
+// and its truncation error is estimated from the third difference of the last four charges, |N'''| dt^2 / 6.
+// The first rate is available after four steps.
+class ContinuityCurrent
+{
+    public:
+        ContinuityCurrent () {}
+        ContinuityCurrent (Real dt, const vector<string>& parts)
+        : _dt (dt)
+        , _parts (parts)
+        {}
+
+        // After a time step; ns: densities (0-index by site)
+        void add (const vector<Real>& ns, const ToLocDict& to_loc)
+        {
+            vector<Real> Ns (_parts.size(), 0.);
+            for(int i = 1; i < to_loc.size(); i++)
+            {
+                auto it = std::find (_parts.begin(), _parts.end(), to_loc.at(i).first);
+                if (it != _parts.end())
+                    Ns.at (it - _parts.begin()) += ns.at(i-1);
+            }
+            _Ns.push_back (Ns);
+            if (_Ns.size() > 4)
+                _Ns.pop_front();
+        }
+
+        bool ready () const { return _Ns.size() == 4; }
+
+        // dN/dt of the partition <name> and its error estimate
+        pair<Real,Real> rate (const string& name) const
+        {
+            mycheck (ready(), "not enough steps");
+            auto it = std::find (_parts.begin(), _parts.end(), name);
+            mycheck (it != _parts.end(), "unknown partition: "+name);
+            int p = it - _parts.begin();
+            auto N = [this, p] (int i) { return _Ns.at(i).at(p); };
+            Real dN  = (N(3) - N(1)) / (2.*_dt);
+            Real err = abs (N(3) - 3.*N(2) + 3.*N(1) - N(0)) / (6.*_dt);
+            return {dN, err};
+        }
+
+    private:
+        Real                 _dt=0.;
+        vector<string>       _parts;
+        deque<vector<Real>>  _Ns;      // charges of the last four steps
+};
+#endif
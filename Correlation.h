@@ -0,0 +1,119 @@
+#ifndef __CORRELATION_H_CMC__
+#define __CORRELATION_H_CMC__
+#include <thread>
+#include <atomic>
+#include "itensor/all.h"
+#include "Reorder.h"
+using namespace itensor;
+using namespace std;
+
+// Single-particle correlation matrices of the fermionic sites <js> (ascending):
+//      rho(a,b) = <Cdag_i C_j>,   kappa(a,b) = <C_i C_j>,   i = js[a], j = js[b],
+// where kappa is computed only for the sites in <js_anom> (the scatterer; the other sites conserve the particle number).
+//
+// The orthogonality center c of the MPS must be at or before js[0], so that the sites on its left are the identity and
+// every element is closed on the right without an environment; otherwise the MPS is brought to c = js[0].
+// A caller on a worker thread should gauge the MPS beforehand, since position() creates new link indices.
+// The left environments of the sites from c on are built once.
+// Row a starts Cdag_i (and C_i) on the environment of site i and is carried to the right through the Jordan-Wigner strings,
+// giving all the elements of the row in one pass. The cost is O(n N m^3), and the rows are distributed over <nthreads> threads.
+//
+// "C" is the bare annihilator, so that Cdag_i C_j = Cdag_i F_i+1...F_j-1 C_j and C_i C_j = -C_i F_i+1...F_j-1 C_j.
+template <typename SiteType>
+pair<CMatrix,CMatrix>
+correlation_matrices (MPS psi, const SiteType& sites, const vector<int>& js, const vector<int>& js_anom={}, int nthreads=1)
+{
+    int n = js.size();
+    CMatrix rho (n,n), kappa (n,n);
+    if (n == 0)
+        return {rho, kappa};
+    int N = length(psi);
+    int c = leftLim(psi)+1;
+    if (c != rightLim(psi)-1 or c > js.front())
+    {
+        c = js.front();
+        psi.position (c);
+    }
+
+    vector<bool> anom (N+1, false);
+    for(int j : js_anom)
+        anom.at(j) = true;
+
+    // Bra of site k with the site index and the chosen links primed
+    auto bra = [&psi, N] (int k, bool left, bool right)
+    {
+        auto A = prime (psi(k), "Site");
+        if (left and k > 1)  A.prime (leftLinkIndex (psi,k));
+        if (right and k < N) A.prime (rightLinkIndex (psi,k));
+        return dag(A);
+    };
+    // Extend the environment E by site k with the operator op (the identity if op is empty).
+    // With <close> the right link is contracted, which gives the expectation value.
+    auto extend = [&] (const ITensor& E, int k, const ITensor& op, bool close)
+    {
+        bool left = (k > c);
+        ITensor T = (left ? E * psi(k) : psi(k));
+        if (op)
+            T *= op;
+        else
+            T.prime ("Site");
+        T *= bra (k, left, !close);
+        return T;
+    };
+
+    // Left environments of the sites c,...,js.back()-1; Ls[c-1] is empty
+    vector<ITensor> Ls (N+1);
+    for(int k = c; k < js.back(); k++)
+        Ls.at(k) = extend (Ls.at(k-1), k, ITensor(), false);
+
+    auto row = [&] (int a)
+    {
+        int i = js.at(a);
+        auto const& E0 = Ls.at(i-1);
+        rho(a,a) = eltC (extend (E0, i, sites.op("N",i), true));
+        if (a == n-1) return;
+
+        auto Ed = extend (E0, i, sites.op("Cdag",i), false);
+        ITensor Ea;
+        if (anom.at(i))
+            Ea = extend (E0, i, sites.op("C",i), false);
+        int b = a+1;
+        for(int k = i+1; k <= js.back(); k++)
+        {
+            if (k == js.at(b))
+            {
+                auto Ck = sites.op("C",k);
+                rho(a,b) = eltC (extend (Ed, k, Ck, true));
+                rho(b,a) = std::conj (rho(a,b));
+                if (anom.at(i) and anom.at(k))
+                {
+                    kappa(a,b) = -eltC (extend (Ea, k, Ck, true));
+                    kappa(b,a) = -kappa(a,b);
+                }
+                b++;
+                if (b == n) break;
+            }
+            // Jordan-Wigner string; the charge site is bosonic
+            auto F = (is_fermion_site (sites(k)) ? sites.op("F",k) : ITensor());
+            Ed = extend (Ed, k, F, false);
+            if (anom.at(i))
+                Ea = extend (Ea, k, F, false);
+        }
+    };
+
+    // Every row writes only its own upper-triangle elements and their transposes
+    std::atomic<int> next (0);
+    auto work = [&] ()
+    {
+        for(int a = next++; a < n; a = next++)
+            row (a);
+    };
+    vector<std::thread> threads;
+    for(int t = 1; t < nthreads; t++)
+        threads.emplace_back (work);
+    work ();
+    for(auto& th : threads)
+        th.join();
+    return {rho, kappa};
+}
+#endif
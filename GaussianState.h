@@ -0,0 +1,235 @@
+#ifndef __GAUSSIANSTATE_H_CMC__
+#define __GAUSSIANSTATE_H_CMC__
+#include "itensor/all.h"
+#include "SortBasis.h"
+#include "Hamiltonian.h"
+using namespace itensor;
+using namespace std;
+
+// Non-interacting (Gaussian) model of the system in the mixed basis, without the charge site.
+//
+// The quadratic Hamiltonian
+//      H = sum_ab A_ab Cdag_a C_b + sum_ab Bd_ab Cdag_a Cdag_b + sum_ab Bc_ab C_a C_b
+// is written in the Nambu form H = (1/2) Psi^dag Hn Psi + const, Psi = (C_1..C_N, Cdag_1..Cdag_N),
+//      Hn = [ A          Bd - Bd^T ]
+//           [ Bc - Bc^T  -A^T      ]
+// The state is described by the generalized correlation matrix G_ab = <Psi_a Psi_b^dag> (2N x 2N),
+// stored as real and imaginary parts.
+class GaussianModel
+{
+    public:
+        GaussianModel () {}
+        // <orbs> are the orbitals, in the order of the Gaussian indices (1-index in the dictionary)
+        GaussianModel (const vector<SortInfo>& orbs)
+        {
+            int i = 0;
+            for(auto const& [name, k, en] : orbs)
+            {
+                if (name == PartC::name) continue;
+                _index.set ({name,k}, i++);
+                _orbs.emplace_back (name, k);
+            }
+            int N = i;
+            _A  = Matrix (N,N);
+            _Bd = Matrix (N,N);
+            _Bc = Matrix (N,N);
+        }
+
+        int size () const { return _orbs.size(); }
+        int index (const string& name, int k) const { return _index.at ({name,k}); }
+        const pair<string,int>& orb (int i) const { return _orbs.at(i); }
+
+        // Add coef * C(j1,dag1) C(j2,dag2)
+        void add_term (Real coef, int j1, bool dag1, int j2, bool dag2)
+        {
+            if (dag1 and !dag2)       _A(j1,j2) += coef;
+            else if (!dag1 and dag2)  _A(j2,j1) -= coef;       // C_a Cdag_b = delta_ab - Cdag_b C_a
+            else if (dag1 and dag2)   _Bd(j1,j2) += coef;
+            else                      _Bc(j1,j2) += coef;
+        }
+
+        // The same terms as add_CdagC, without the charge operator
+        template <typename Basis1, typename Basis2>
+        void add_CdagC (const Basis1& basis1, const Basis2& basis2, int i1, int i2, Real coef)
+        {
+            if (i1 < 0) i1 += basis1.n_sites() + 1;
+            if (i2 < 0) i2 += basis2.n_sites() + 1;
+            auto terms = quadratic_operator_new (basis1, basis2, i1, i2, true, false);
+            int pid1 = _index.part_id (basis1.name()),
+                pid2 = _index.part_id (basis2.name());
+            for(auto [c12, k1, dag1, k2, dag2] : terms)
+                add_term (coef * c12, _index.at (pid1,k1), dag1, _index.at (pid2,k2), dag2);
+        }
+
+        template <typename Basis>
+        void add_diag (const Basis& basis)
+        {
+            int pid = _index.part_id (basis.name());
+            for(int k = 1; k <= basis.size(); k++)
+            {
+                int j = _index.at (pid,k);
+                _A(j,j) += basis.en(k);
+            }
+            for(auto [k1, k2, h] : offdiag_terms (basis))
+                _A(_index.at (pid,k1), _index.at (pid,k2)) += h;
+            for(auto [k1, k2, B] : pairing_terms (basis))
+            {
+                add_term (B,  _index.at (pid,k1), true,  _index.at (pid,k2), true);
+                add_term (-B, _index.at (pid,k1), false, _index.at (pid,k2), false);
+            }
+        }
+
+        Matrix nambu_H () const
+        {
+            int N = size();
+            Matrix Hn (2*N,2*N);
+            for(int a = 0; a < N; a++)
+                for(int b = 0; b < N; b++)
+                {
+                    Hn(a,b)     = _A(a,b);
+                    Hn(N+a,N+b) = -_A(b,a);
+                    Hn(a,N+b)   = _Bd(a,b) - _Bd(b,a);
+                    Hn(N+a,b)   = _Bc(a,b) - _Bc(b,a);
+                }
+            return Hn;
+        }
+
+        // Product state with occupations ns (0 or 1, or any value in between for a diagonal mixed state)
+        void set_product_state (const vector<Real>& ns)
+        {
+            int N = size();
+            mycheck (ns.size() == N, "size not match");
+            _Gr = Matrix (2*N,2*N);
+            _Gi = Matrix (2*N,2*N);
+            for(int a = 0; a < N; a++)
+            {
+                _Gr(a,a) = 1.-ns.at(a);     // <C_a Cdag_a>
+                _Gr(N+a,N+a) = ns.at(a);    // <Cdag_a C_a>
+            }
+        }
+
+        // G(t) = U G U^dag, U = exp(-i Hn t) = V (cos - i sin) V^T
+        void evolve (Real t)
+        {
+            auto Hn = nambu_H ();
+            Matrix V;
+            Vector E;
+            diagHermitian (Hn, V, E);
+            int M = E.size();
+            Matrix Vc (M,M), Vs (M,M);
+            for(int j = 0; j < M; j++)
+            {
+                column (Vc,j) &= cos (E(j)*t) * column (V,j);
+                column (Vs,j) &= sin (E(j)*t) * column (V,j);
+            }
+            Matrix Ur = Vc * transpose(V),
+                   Ui = Vs * transpose(V);
+            // (Ur - i Ui) (Gr + i Gi) (Ur^T + i Ui^T)
+            Matrix Pr = Ur * _Gr + Ui * _Gi,
+                   Pi = Ur * _Gi - Ui * _Gr;
+            _Gr = Pr * transpose(Ur) - Pi * transpose(Ui);
+            _Gi = Pr * transpose(Ui) + Pi * transpose(Ur);
+        }
+
+        // <Cdag_a C_b>
+        Cplx CdagC (int a, int b) const
+        {
+            int N = size();
+            return Cplx (_Gr(N+a,N+b), _Gi(N+a,N+b));
+        }
+
+        // Von Neumann entropy of the orbitals <is>
+        Real entropy (const vector<int>& is) const;
+
+        // Mutual information I_ab = S_a + S_b - S_ab for all pairs
+        Matrix mutual_information () const;
+
+    private:
+        ToGlobDict               _index;    // {name,k} -> 0-index
+        vector<pair<string,int>> _orbs;
+        Matrix                   _A, _Bd, _Bc;
+        Matrix                   _Gr, _Gi;
+};
+
+// The reduced state of <is> is Gaussian with the sub-block of G.
+// Its eigenvalues come in pairs (l, 1-l), and S = -sum_all l ln(l).
+// The Hermitian sub-block is diagonalized as the real symmetric matrix [[Re,-Im],[Im,Re]],
+// which doubles each eigenvalue.
+Real GaussianModel :: entropy (const vector<int>& is) const
+{
+    int N = size();
+    int n = is.size();
+    vector<int> rows;
+    for(int a : is) rows.push_back (a);
+    for(int a : is) rows.push_back (N+a);
+    int m = rows.size();
+    Matrix R (2*m,2*m);
+    for(int x = 0; x < m; x++)
+        for(int y = 0; y < m; y++)
+        {
+            Real gr = _Gr (rows[x],rows[y]),
+                 gi = _Gi (rows[x],rows[y]);
+            R(x,y)     = gr;
+            R(m+x,m+y) = gr;
+            R(x,m+y)   = -gi;
+            R(m+x,y)   = gi;
+        }
+    Matrix V;
+    Vector ls;
+    diagHermitian (R, V, ls);
+    Real S = 0.;
+    for(int j = 0; j < ls.size(); j++)
+    {
+        Real l = ls(j);
+        if (l > 1e-14)
+            S -= l * log(l);
+    }
+    return 0.5 * S;
+}
+
+Matrix GaussianModel :: mutual_information () const
+{
+    int N = size();
+    vector<Real> S1 (N);
+    for(int a = 0; a < N; a++)
+        S1.at(a) = entropy ({a});
+    Matrix I (N,N);
+    for(int a = 0; a < N; a++)
+        for(int b = a+1; b < N; b++)
+        {
+            Real Iab = S1.at(a) + S1.at(b) - entropy ({a,b});
+            I(a,b) = I(b,a) = max (Iab, 0.);
+        }
+    return I;
+}
+
+// Gaussian model of get_ampo_Kitaev_chain (without charging and Josephson terms)
+// in the initial state of get_ground_state_BdG_scatter (leads filled up to muL, muR; empty scatterer)
+template <typename BasisL, typename BasisR, typename BasisS, typename Para>
+GaussianModel get_gaussian_Kitaev_chain (const vector<SortInfo>& orbs, const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer,
+                                         Real muL, Real muR, const Para& para)
+{
+    GaussianModel g (orbs);
+    g.add_diag (leadL);
+    g.add_diag (leadR);
+    g.add_diag (scatterer);
+    g.add_CdagC (leadL, scatterer, -1, 1, -para.tcL);
+    g.add_CdagC (scatterer, leadL, 1, -1, -para.tcL);
+    g.add_CdagC (leadR, scatterer, 1, -1, -para.tcR);
+    g.add_CdagC (scatterer, leadR, -1, 1, -para.tcR);
+    if (para.sigL != 0.) g.add_CdagC (scatterer, scatterer, 1, 1, para.tcL*para.tcL*para.sigL);
+    if (para.sigR != 0.) g.add_CdagC (scatterer, scatterer, -1, -1, para.tcR*para.tcR*para.sigR);
+
+    vector<Real> ns (g.size(), 0.);
+    auto fill = [&g, &ns] (const auto& basis, Real mu)
+    {
+        for(int k = 1; k <= basis.size(); k++)
+            if (basis.en(k) < mu)
+                ns.at (g.index (basis.name(), k)) = 1.;
+    };
+    fill (leadL, muL);
+    fill (leadR, muR);
+    g.set_product_state (ns);
+    return g;
+}
+#endif
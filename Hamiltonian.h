@@ -1,34 +1,89 @@
 #ifndef __HAMILTONIAN_H_CMC__
 #define __HAMILTONIAN_H_CMC__
+#include "ParamMPO.h"
+#include "OneParticleBasis.h"
+#include "BdGBasis.h"
+
+// Terms dropped by quadratic_operator_new
+struct PruneInfo
+{
+    int  n_dropped = 0;
+    Real discarded_norm = 0.;      // sqrt of the sum of |coef|^2 of the dropped terms
+};
 
 // C(i1,dag1) * C(i2,dag2) = \sum_k1 coef_i1,k1 C(k1,dag'1) * \sum_k2 coef_i2,k2 C(k2,dag'2)
 // Return: vector of (coef, k1, dag'1, k2, dag'2)
+//
+// Terms with |coef| <= cutoff are dropped. The rows from C_op are sorted by magnitude,
+// so the loops stop at the first term below the cutoff.
+// If max_discard > 0, the smallest of the remaining terms are also dropped as long as
+// the norm of all the dropped terms stays below max_discard.
+// The number of dropped terms and their norm are written to <info> if given.
 template <typename Basis1, typename Basis2>
-vector <tuple <auto,int,bool,int,bool>>
-quadratic_operator_new (const Basis1& basis1, const Basis2& basis2, int i1, int i2, bool dag1, bool dag2, Real cutoff=1e-16)
+vector <tuple <Real,int,bool,int,bool>>
+quadratic_operator_new (const Basis1& basis1, const Basis2& basis2, int i1, int i2, bool dag1, bool dag2, Real cutoff=1e-16,
+                        Real max_discard=0., PruneInfo* info=nullptr)
 {
     auto C1 = basis1.C_op (i1, dag1);     // i -> k, coef, dag
     auto C2 = basis2.C_op (i2, dag2);
 
+    // Suffix sums of |coef|^2 for the norm of the terms skipped by the early exit
+    vector<Real> tail2 (C2.size()+1, 0.);
+    for(int j = C2.size()-1; j >= 0; j--)
+        tail2.at(j) = tail2.at(j+1) + pow (abs(get<1>(C2[j])), 2);
+
+    PruneInfo pinfo;
+    Real discard2 = 0.;
     vector<tuple <Real,int,bool,int,bool>> ops;             // coef, k1, dag1, k2, dag2
     for(auto&& [k1,c1,dag1p] : C1)
     {
-        for(auto&& [k2,c2,dag2p] : C2)
+        int j = 0;
+        for(; j < C2.size(); j++)
         {
+            auto&& [k2,c2,dag2p] = C2[j];
             auto coef = c1*c2;
-            if (abs(coef) > cutoff)
-                ops.emplace_back (coef,k1,dag1p,k2,dag2p);    // Cdag_ki1 C_ki2
+            if (!(abs(coef) > cutoff))
+                break;
+            ops.emplace_back (coef,k1,dag1p,k2,dag2p);    // Cdag_ki1 C_ki2
+        }
+        pinfo.n_dropped += C2.size() - j;
+        discard2 += pow (abs(c1), 2) * tail2.at(j);
+    }
+
+    // Drop the smallest terms within the error bound
+    if (max_discard > 0.)
+    {
+        auto larger = [] (const auto& t1, const auto& t2) { return abs(get<0>(t1)) > abs(get<0>(t2)); };
+        std::sort (ops.begin(), ops.end(), larger);
+        Real bound2 = max_discard * max_discard;
+        while (ops.size() > 0)
+        {
+            Real c2 = pow (abs(get<0>(ops.back())), 2);
+            if (discard2 + c2 > bound2)
+                break;
+            discard2 += c2;
+            ops.pop_back();
+            pinfo.n_dropped++;
         }
     }
+
+    pinfo.discarded_norm = sqrt (discard2);
+    if (info)
+        *info = pinfo;
     return ops;
 }
 
 template <typename Basis1, typename Basis2, typename NumType>
-void add_CdagC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i1, int i2, NumType coef, const ToGlobDict& to_glob)
+void add_CdagC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i1, int i2, NumType coef, const ToGlobDict& to_glob,
+                Real max_discard=0.)
 {
-    if (i1 < 0) i1 += basis1.size() + 1;
-    if (i2 < 0) i2 += basis2.size() + 1;
-    vector <tuple <auto,int,bool,int,bool>> terms = quadratic_operator_new (basis1, basis2, i1, i2, true, false);
+    if (i1 < 0) i1 += basis1.n_sites() + 1;
+    if (i2 < 0) i2 += basis2.n_sites() + 1;
+    PruneInfo pinfo;
+    auto terms = quadratic_operator_new (basis1, basis2, i1, i2, true, false, 1e-16, max_discard, &pinfo);
+    if (max_discard > 0.)
+        cout << "CdagC " << basis1.name() << i1 << " " << basis2.name() << i2 << ": keep " << terms.size()
+             << " terms, drop " << pinfo.n_dropped << ", discarded norm = " << pinfo.discarded_norm << endl;
 
     // 
     string p1 = basis1.name(),
@@ -45,11 +100,13 @@ void add_CdagC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i
         op_charge = "Adag";
     }
     // Hopping terms
-    int jc = to_glob.at({"C",1});
+    int jc = to_glob.at (PartC(), 1);
+    int pid1 = to_glob.part_id (p1),
+        pid2 = to_glob.part_id (p2);
     for(auto [c12, k1, dag1, k2, dag2] : terms)  // coef, k1, dag1, k2, dag2
     {
-        int j1 = to_glob.at({p1,k1});
-        int j2 = to_glob.at({p2,k2});
+        int j1 = to_glob.at (pid1,k1);
+        int j2 = to_glob.at (pid2,k2);
         string op1 = (dag1 ? "Cdag" : "C");
         string op2 = (dag2 ? "Cdag" : "C");
         Real c = coef * c12;
@@ -69,16 +126,16 @@ void add_CdagC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i
 template <typename Basis1, typename Basis2, typename NumType>
 void add_SC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i1, int i2, NumType Delta, const ToGlobDict& to_glob)
 {
-    if (i1 < 0) i1 += basis1.size()+1;
-    if (i2 < 0) i2 += basis2.size()+1;
-    vector <tuple <auto,int,bool,int,bool>> terms = quadratic_operator_new (basis1, basis2, i1, i2, false, false);
+    if (i1 < 0) i1 += basis1.n_sites() + 1;
+    if (i2 < 0) i2 += basis2.n_sites() + 1;
+    auto terms = quadratic_operator_new (basis1, basis2, i1, i2, false, false);
 
-    string p1 = basis1.name(),
-           p2 = basis2.name();
+    int pid1 = to_glob.part_id (basis1.name()),
+        pid2 = to_glob.part_id (basis2.name());
     for(auto [c12, k1, dag1, k2, dag2] : terms)  // coef, k1, dag1, k2, dag2
     {
-        int j1 = to_glob.at({p1,k1});
-        int j2 = to_glob.at({p2,k2});
+        int j1 = to_glob.at (pid1,k1);
+        int j2 = to_glob.at (pid2,k2);
         if (j1 != j2)
         {
             auto c = Delta * c12;
@@ -89,6 +146,57 @@ void add_SC (AutoMPO& ampo, const Basis1& basis1, const Basis2& basis2, int i1,
     }
 }
 
+// Off-diagonal single-particle terms (k1, k2, h); only a rotated OneParticleBasis and a real-space BdGBasis have them
+template <typename Basis>
+vector<tuple<int,int,Real>> offdiag_terms (const Basis&) { return {}; }
+inline vector<tuple<int,int,Real>> offdiag_terms (const OneParticleBasis& basis) { return basis.offdiag_terms(); }
+inline vector<tuple<int,int,Real>> offdiag_terms (const BdGBasis& basis)         { return basis.offdiag_terms(); }
+
+// Pairing terms (k1, k2, B) for B Cdag_k1 Cdag_k2 - B C_k1 C_k2; only a real-space BdGBasis has them
+template <typename Basis>
+vector<tuple<int,int,Real>> pairing_terms (const Basis&) { return {}; }
+inline vector<tuple<int,int,Real>> pairing_terms (const BdGBasis& basis) { return basis.pairing_terms(); }
+
+// Constant of the BdG basis of the scatterer <sname>; zero for the other bases
+template <typename Basis>
+Real diag_constant (const Basis& basis, const string& sname)
+{
+    Real c = 0.;
+    if (basis.name() == sname)
+        for(int i = 1; i <= basis.size(); i++)
+            c += -0.5 * (basis.en(i) + basis.mu(i));
+    return c;
+}
+
+// Single-particle energies; for the scatterer <sname> also the constant of the BdG basis, unless <constant> is false.
+// The off-diagonal and pairing terms of the bases which are not diagonal are included.
+template <typename Basis>
+void add_diag_terms (AutoMPO& ampo, const Basis& basis, const string& sname, const ToGlobDict& to_glob, bool constant=true)
+{
+    string p = basis.name();
+    int pid = to_glob.part_id (p);
+    for(int i = 1; i <= basis.size(); i++)
+    {
+        int j = to_glob.at (pid,i);
+        auto en = basis.en(i);
+        ampo += en, "N", j;
+        if (p == sname and constant)
+        {
+            auto mu = basis.mu(i);
+            ampo += -0.5 * (en + mu), "I", i;
+        }
+    }
+    for(auto [k1, k2, h] : offdiag_terms (basis))
+        ampo += h, "Cdag", to_glob.at (pid,k1), "C", to_glob.at (pid,k2);
+    for(auto [k1, k2, B] : pairing_terms (basis))
+    {
+        int j1 = to_glob.at (pid,k1),
+            j2 = to_glob.at (pid,k2);
+        ampo += B, "Cdag", j1, "Cdag", j2;
+        ampo += -B, "C", j1, "C", j2;
+    }
+}
+
 template <typename BasisL, typename BasisR, typename BasisS, typename BasisC, typename SiteType, typename Para>
 AutoMPO get_ampo_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer, const BasisC& charge, const SiteType& sites, const Para& para, const ToGlobDict& to_glob)
 {
@@ -98,24 +206,9 @@ AutoMPO get_ampo_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const B
 
     // Diagonal terms
     string sname = scatterer.name();
-    auto add_diag = [&ampo, &to_glob, &sname] (const auto& basis)
-    {
-        string p = basis.name();
-        for(int i = 1; i <= basis.size(); i++)
-        {
-            int j = to_glob.at({p,i});
-            auto en = basis.en(i);
-            ampo += en, "N", j;
-            if (p == sname)
-            {
-                auto mu = basis.mu(i);
-                ampo += -0.5 * (en + mu), "I", i;
-            }
-        }
-    };
-    add_diag (leadL);
-    add_diag (leadR);
-    add_diag (scatterer);
+    add_diag_terms (ampo, leadL, sname, to_glob);
+    add_diag_terms (ampo, leadR, sname, to_glob);
+    add_diag_terms (ampo, scatterer, sname, to_glob);
 
     // Contact hopping
     add_CdagC (ampo, leadL, scatterer, -1, 1, -para.tcL, to_glob);
@@ -123,6 +216,12 @@ AutoMPO get_ampo_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const B
     add_CdagC (ampo, leadR, scatterer, 1, -1, -para.tcR, to_glob);
     add_CdagC (ampo, scatterer, leadR, -1, 1, -para.tcR, to_glob);
 
+    // Energy shift of the device contact sites from the dropped lead orbitals (see LeadReduction.h)
+    if (para.sigL != 0.)
+        add_CdagC (ampo, scatterer, scatterer, 1, 1, para.tcL*para.tcL*para.sigL, to_glob);
+    if (para.sigR != 0.)
+        add_CdagC (ampo, scatterer, scatterer, -1, -1, para.tcR*para.tcR*para.sigR, to_glob);
+
     // Charging energy
     string cname = charge.name();
     if (para.Ec != 0.)
@@ -152,4 +251,153 @@ AutoMPO get_ampo_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const B
     }
     return ampo;
 }
+// The same Hamiltonian as get_ampo_Kitaev_chain, split into
+//   diagonal part, left contact, right contact, charging + Josephson part
+// to be used as a lazily summed set of MPOs (LocalMPOSet).
+// The diagonal and charging MPOs have bond dimension 2 (more with the off-diagonal terms of coupled lead modes
+// or of a real-space scatterer). The contact MPOs are not local in the energy basis: the contact site has weight on
+// every lead orbital, so each contact MPO carries its channels across all the orbitals of its lead.
+// The set also pays one environment update per MPO at every site. Whether it is cheaper than the single MPO therefore
+// depends on the sizes and the ordering; benchmark_step times both, environments included, with benchmark_local_product.
+template <typename BasisL, typename BasisR, typename BasisS, typename BasisC, typename SiteType, typename Para>
+vector<AutoMPO> get_ampo_set_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer, const BasisC& charge, const SiteType& sites, const Para& para, const ToGlobDict& to_glob)
+{
+    mycheck (length(sites) == to_glob.size(), "size not match");
+
+    AutoMPO ampo_diag (sites), ampo_L (sites), ampo_R (sites), ampo_C (sites);
+
+    // Diagonal terms
+    string sname = scatterer.name();
+    add_diag_terms (ampo_diag, leadL, sname, to_glob);
+    add_diag_terms (ampo_diag, leadR, sname, to_glob);
+    add_diag_terms (ampo_diag, scatterer, sname, to_glob);
+
+    // Contact hopping
+    add_CdagC (ampo_L, leadL, scatterer, -1, 1, -para.tcL, to_glob);
+    add_CdagC (ampo_L, scatterer, leadL, 1, -1, -para.tcL, to_glob);
+    add_CdagC (ampo_R, leadR, scatterer, 1, -1, -para.tcR, to_glob);
+    add_CdagC (ampo_R, scatterer, leadR, -1, 1, -para.tcR, to_glob);
+    if (para.sigL != 0.)
+        add_CdagC (ampo_L, scatterer, scatterer, 1, 1, para.tcL*para.tcL*para.sigL, to_glob);
+    if (para.sigR != 0.)
+        add_CdagC (ampo_R, scatterer, scatterer, -1, -1, para.tcR*para.tcR*para.sigR, to_glob);
+
+    // Charging energy and Josephson hopping.
+    // Always keep the identity so that the MPO is not empty.
+    int jc = to_glob.at({charge.name(),1});
+    ampo_C += para.Ec,"NSqr",jc;
+    ampo_C += para.Ec * para.Ng * para.Ng, "I", jc;
+    ampo_C += -2.*para.Ec * para.Ng, "N", jc;
+    if (para.EJ != 0.)
+    {
+        ampo_C += para.EJ,"A2",jc;
+        ampo_C += para.EJ,"A2dag",jc;
+    }
+    return {ampo_diag, ampo_L, ampo_R, ampo_C};
+}
+
+// A group of Hamiltonian terms with unit coefficient: the operator terms, and the constant kept apart for ParamMPO
+struct TermGroup
+{
+    string  name;
+    AutoMPO ampo;
+    bool    has_terms = true;
+    Real    id = 0.;
+};
+
+// The Hamiltonian of get_ampo_Kitaev_chain grouped by scalar parameters, for time-dependent protocols.
+// The coefficients of the groups are given by Kitaev_chain_coefs.
+// The Josephson group is included only if para.EJ != 0, since it does not conserve the charge.
+template <typename BasisL, typename BasisR, typename BasisS, typename BasisC, typename SiteType, typename Para>
+vector<TermGroup>
+get_ampo_groups_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer, const BasisC& charge, const SiteType& sites, const Para& para, const ToGlobDict& to_glob)
+{
+    mycheck (length(sites) == to_glob.size(), "size not match");
+
+    // Diagonal terms
+    AutoMPO ampo_diag (sites);
+    string sname = scatterer.name();
+    add_diag_terms (ampo_diag, leadL, sname, to_glob, false);
+    add_diag_terms (ampo_diag, leadR, sname, to_glob, false);
+    add_diag_terms (ampo_diag, scatterer, sname, to_glob, false);
+    Real const_diag = diag_constant (scatterer, sname);
+
+    // Contact hopping
+    AutoMPO ampo_tcL (sites), ampo_tcR (sites);
+    add_CdagC (ampo_tcL, leadL, scatterer, -1, 1, -1., to_glob);
+    add_CdagC (ampo_tcL, scatterer, leadL, 1, -1, -1., to_glob);
+    add_CdagC (ampo_tcR, leadR, scatterer, 1, -1, -1., to_glob);
+    add_CdagC (ampo_tcR, scatterer, leadR, -1, 1, -1., to_glob);
+
+    // Charging energy: Ec * (N - Ng)^2 = Ec * NSqr - 2 Ec Ng * N + Ec Ng^2
+    int jc = to_glob.at({charge.name(),1});
+    AutoMPO ampo_NSqr (sites), ampo_N (sites);
+    ampo_NSqr += 1.,"NSqr",jc;
+    ampo_N    += 1.,"N",jc;
+
+    vector<TermGroup> groups = {{"diag",ampo_diag,true,const_diag}, {"tcL",ampo_tcL}, {"tcR",ampo_tcR},
+                                {"EcNSqr",ampo_NSqr}, {"EcN",ampo_N}, {"EcI",AutoMPO(sites),false,1.}};
+    // Energy shift from the dropped lead orbitals, proportional to tc^2
+    if (para.sigL != 0.)
+    {
+        AutoMPO ampo_sigL (sites);
+        add_CdagC (ampo_sigL, scatterer, scatterer, 1, 1, 1., to_glob);
+        groups.push_back ({"sigL", ampo_sigL});
+    }
+    if (para.sigR != 0.)
+    {
+        AutoMPO ampo_sigR (sites);
+        add_CdagC (ampo_sigR, scatterer, scatterer, -1, -1, 1., to_glob);
+        groups.push_back ({"sigR", ampo_sigR});
+    }
+    // Josephson hopping
+    if (para.EJ != 0.)
+    {
+        AutoMPO ampo_EJ (sites);
+        ampo_EJ += 1.,"A2",jc;
+        ampo_EJ += 1.,"A2dag",jc;
+        groups.push_back ({"EJ", ampo_EJ});
+    }
+    return groups;
+}
+
+// Coefficients of the groups in get_ampo_groups_Kitaev_chain
+template <typename Para>
+vector<pair<string,Real>> Kitaev_chain_coefs (const Para& para)
+{
+    return {{"diag",1.}, {"tcL",para.tcL}, {"tcR",para.tcR},
+            {"EcNSqr",para.Ec}, {"EcN",-2.*para.Ec*para.Ng}, {"EcI",para.Ec*para.Ng*para.Ng},
+            {"EJ",para.EJ}, {"sigL",para.tcL*para.tcL*para.sigL}, {"sigR",para.tcR*para.tcR*para.sigR}};
+}
+
+template <typename BasisL, typename BasisR, typename BasisS, typename BasisC, typename SiteType, typename Para>
+ParamMPO get_param_mpo_Kitaev_chain (const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer, const BasisC& charge, const SiteType& sites, const Para& para, const ToGlobDict& to_glob)
+{
+    auto groups = get_ampo_groups_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob);
+    auto coefs = Kitaev_chain_coefs (para);
+    vector<string> names;
+    vector<MPO> Hs;
+    vector<Real> cs, ids;
+    for(auto const& gr : groups)
+    {
+        names.push_back (gr.name);
+        Hs.push_back (gr.has_terms ? toMPO (gr.ampo) : MPO());
+        ids.push_back (gr.id);
+        for(auto const& [namec, c] : coefs)
+            if (namec == gr.name)
+                cs.push_back (c);
+    }
+    return ParamMPO (names, Hs, cs, ids);
+}
+
+// Return true if any coefficient changed
+template <typename Para>
+bool update_param_mpo (ParamMPO& H, const Para& para)
+{
+    bool changed = false;
+    for(auto const& [name, c] : Kitaev_chain_coefs (para))
+        if (H.has (name))
+            changed = H.set_coef (name, c) or changed;
+    return changed;
+}
 #endif
@@ -0,0 +1,117 @@
+#ifndef __HYBRIDLEAD_H_CMC__
+#define __HYBRIDLEAD_H_CMC__
+#include "OneParticleBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Lead with the n_real sites next to the device kept in real space and the rest of the chain diagonalized.
+//
+// The modes are the eigenstates of the far part of the chain and the real-space sites near the contact.
+// The Hamiltonian in these modes is diagonal in the far part, tridiagonal in the real-space part,
+// and couples the real-space site next to the far part to every far mode k by -t_b U(b,k),
+// where b is the boundary site of the far part. The contact hopping to the device is then a single term.
+//
+// contact_right: true for the left lead (the contact is the last site), false for the right lead
+// keep_sites:    the real-space sites for which C_op is needed (1-index; negative counts from the end)
+//
+// The result is a OneParticleBasis with off-diagonal terms, so sort_by_energy_charging and add_CdagC work unchanged.
+// Since Hk is not diagonal, filling the modes with en(k) < mu is not the Fermi sea of the lead;
+// get_initial_state finds the lead ground state by DMRG instead.
+OneParticleBasis hybrid_lead (const string& name, int L, Real t, Real mu, Real damp_fac, bool damp_from_right, bool contact_right,
+                              int n_real, const vector<int>& keep_sites)
+{
+    mycheck (n_real >= 1 and n_real < L, "n_real must be between 1 and L-1");
+    auto ts = tight_binding_hoppings (L, t, damp_fac, damp_from_right);
+    int Lf = L - n_real;
+    // 0-index sites: far part [f0,f0+Lf), real-space part [r0,r0+n_real); boundary bond between fb and rb
+    int f0 = (contact_right ? 0 : n_real),
+        r0 = (contact_right ? Lf : 0);
+    int fb = (contact_right ? Lf-1 : n_real),
+        rb = (contact_right ? Lf : n_real-1);
+    Real tb = ts.at (min(fb,rb));
+
+    // Rows to store
+    vector<int> rows (L, -1);
+    vector<int> is;
+    for(int i : keep_sites)
+    {
+        if (i < 0) i += L+1;
+        mycheck (i > 0 and i <= L, "out of range");
+        if (rows.at(i-1) == -1)
+        {
+            rows.at(i-1) = is.size();
+            is.push_back (i-1);
+        }
+    }
+
+    // Far part; the boundary site is the first requested row
+    vector<Real> d (Lf, -mu), e;
+    for(int i = f0; i < f0+Lf-1; i++)
+        e.push_back (-ts.at(i));
+    vector<int> frows = {fb-f0};
+    for(int i : is)
+        if (i >= f0 and i < f0+Lf)
+            frows.push_back (i-f0);
+    auto [ens_f, U_f] = tridiag_eigen_MRRR (d, e, frows);
+
+    // Modes: far modes and real-space sites, in descending energy
+    vector<pair<Real,int>> modes;       // en, far mode k (>= 0) or -1-r for the real-space site r0+r
+    for(int k = 0; k < Lf; k++)
+        modes.emplace_back (ens_f(k), k);
+    for(int r = 0; r < n_real; r++)
+        modes.emplace_back (-mu, -1-r);
+    std::stable_sort (modes.begin(), modes.end(), [] (const auto& a, const auto& b) { return a.first > b.first; });
+    int M = modes.size();
+
+    Vector ens (M);
+    Matrix U (is.size(), M);
+    Matrix Hk (M,M);
+    vector<int> mode_of_real (n_real);
+    for(int m = 0; m < M; m++)
+    {
+        auto [en, k] = modes.at(m);
+        ens(m) = en;
+        Hk(m,m) = en;
+        if (k >= 0)
+        {
+            for(int r = 0; r < is.size(); r++)
+            {
+                int i = is.at(r);
+                if (i >= f0 and i < f0+Lf)
+                {
+                    int fr = std::find (frows.begin()+1, frows.end(), i-f0) - frows.begin();
+                    U(r,m) = U_f(fr,k);
+                }
+            }
+        }
+        else
+        {
+            int ir = r0 + (-1-k);
+            mode_of_real.at(-1-k) = m;
+            if (rows.at(ir) != -1)
+                U(rows.at(ir),m) = 1.;
+        }
+    }
+
+    // Hoppings inside the real-space part
+    for(int r = 0; r < n_real-1; r++)
+    {
+        int m1 = mode_of_real.at(r),
+            m2 = mode_of_real.at(r+1);
+        Hk(m1,m2) = Hk(m2,m1) = -ts.at(r0+r);
+    }
+    // Coupling of the real-space boundary site to the far modes
+    int mb = mode_of_real.at(rb-r0);
+    for(int m = 0; m < M; m++)
+    {
+        int k = modes.at(m).second;
+        if (k >= 0)
+            Hk(mb,m) = Hk(m,mb) = -tb * U_f(0,k);
+    }
+
+    auto basis = OneParticleBasis (name, ens, U, rows, mu);
+    basis.set_mode_hamilt (Hk);
+    cout << "Hybrid lead " << name << ": " << Lf << " far modes, " << n_real << " real-space sites" << endl;
+    return basis;
+}
+#endif
@@ -1,6 +1,7 @@
 #ifndef __INITSTATE_H_CMC__
 #define __INITSTATE_H_CMC__
 #include "SortBasis.h"
+#include "Hamiltonian.h"
 
 // The charging energy is Ec * (N - Ng)^2
 // Find out N that lowest the charging energy in even and odd number of particle sectors
@@ -48,10 +49,10 @@ MPS get_ground_state_BdG_scatter (const BasisL& leadL, const BasisR& leadR, cons
     // Leads
     auto occ_negative_en_states = [&to_glob, &state] (const auto& basis, Real mu)
     {
-        string p = basis.name();
+        int pid = to_glob.part_id (basis.name());
         for(int k = 1; k <= basis.size(); k++)
         {
-            int i = to_glob.at({p,k});
+            int i = to_glob.at (pid,k);
             auto en = basis.en(k);
             if (en < mu)
                 state.at(i) = "Occ";
@@ -63,10 +64,10 @@ MPS get_ground_state_BdG_scatter (const BasisL& leadL, const BasisR& leadR, cons
     occ_negative_en_states (leadR, muR);
 
     // Scatterer
-    string sname = scatterer.name();
+    int spid = to_glob.part_id (scatterer.name());
     for(int k = 1; k <= scatterer.size(); k++)
     {
-        int i = to_glob.at({sname,k});
+        int i = to_glob.at (spid,k);
         state.at(i) = "Emp";
     }
 
@@ -126,6 +127,113 @@ exit(0);*/
     return psi;
 }
 
+// Number of the single-particle levels of <basis> below mu, with the off-diagonal terms of its modes (hybrid leads)
+template <typename Basis>
+int n_levels_below (const Basis& basis, Real mu)
+{
+    int M = basis.size();
+    Matrix Hk (M,M);
+    for(int k = 1; k <= M; k++)
+        Hk(k-1,k-1) = basis.en(k);
+    for(auto [k1, k2, h] : offdiag_terms (basis))
+        Hk(k1-1,k2-1) = h;
+    Matrix V;
+    Vector E;
+    diagHermitian (Hk, V, E);
+    int n = 0;
+    for(int k = 0; k < M; k++)
+        if (E(k) < mu)
+            n++;
+    return n;
+}
+
+// Initial state by DMRG, for a real-space scatterer (BdGBasis::real_space) or leads whose modes are coupled (hybrid leads).
+// The leads, the scatterer and the charge site are in the ground state of
+//      H0 = sum_k (en_k - mu) N_k + sum_k1!=k2 h_k1k2 Cdag_k1 C_k2 (leads) + H_S + E_C,
+// found by DMRG in the even and the odd sectors. The shifts by muL and muR keep the lead occupations unchanged.
+// The DMRG starts from the n_levels_below lowest orbitals of each lead filled, which is the Fermi sea for uncoupled modes.
+template <typename BasisL, typename BasisR, typename SiteType, typename Para>
+MPS get_ground_state_by_dmrg (const BasisL& leadL, const BasisR& leadR, const BdGBasis& scatterer,
+                              const SiteType& sites, Real muL, Real muR, const Para& para, int maxOcc, const ToGlobDict& to_glob)
+{
+    int N = to_glob.size();
+    mycheck (length(sites) == N, "size not match");
+
+    vector<string> state (N+1);
+    AutoMPO ampo (sites);
+    auto leads = [&to_glob, &state, &ampo] (const auto& basis, Real mu)
+    {
+        int pid = to_glob.part_id (basis.name());
+        vector<pair<Real,int>> ens;
+        for(int k = 1; k <= basis.size(); k++)
+        {
+            int i = to_glob.at (pid,k);
+            auto en = basis.en(k);
+            ens.emplace_back (en, i);
+            state.at(i) = "Emp";
+            ampo += en-mu, "N", i;
+        }
+        for(auto [k1, k2, h] : offdiag_terms (basis))
+            ampo += h, "Cdag", to_glob.at (pid,k1), "C", to_glob.at (pid,k2);
+        std::sort (ens.begin(), ens.end());
+        int n = n_levels_below (basis, mu);
+        for(int m = 0; m < n; m++)
+            state.at (ens.at(m).second) = "Occ";
+    };
+    leads (leadL, muL);
+    leads (leadR, muR);
+
+    // Scatterer
+    int spid = to_glob.part_id (scatterer.name());
+    for(int k = 1; k <= scatterer.size(); k++)
+        state.at (to_glob.at (spid,k)) = "Emp";
+    add_diag_terms (ampo, scatterer, scatterer.name(), to_glob);
+
+    // Charging energy
+    int ic = to_glob.at (PartC(),1);
+    ampo += para.Ec,"NSqr",ic;
+    ampo += para.Ec * para.Ng * para.Ng, "I", ic;
+    ampo += -2.*para.Ec * para.Ng, "N", ic;
+    auto H0 = toMPO (ampo);
+    auto [enC0, enC1, n_even, n_odd] = en_charging_energy (maxOcc, para.Ec, para.Ng);
+
+    auto sweeps = Sweeps (10);
+    sweeps.maxdim() = 20,50,100,200;
+    sweeps.cutoff() = 1e-12;
+    auto solve = [&] (bool odd)
+    {
+        auto st = state;
+        if (odd)
+            st.at (to_glob.at (spid,1)) = "Occ";
+        st.at(ic) = str (odd ? n_odd : n_even);
+        InitState init (sites);
+        for(int i = 1; i <= N; i++)
+            init.set (i, st.at(i));
+        auto psi = MPS (init);
+        auto en = dmrg (psi, H0, sweeps, {"Quiet",true,"Silent",true});
+        return pair<Real,MPS> (en, psi);
+    };
+    auto [en0, psi0] = solve (false);
+    auto [en1, psi1] = solve (true);
+    cout << "E (even,odd) = " << en0 << ", " << en1 << endl;
+    cout << "Ground state has " << (en0 <= en1 ? "even" : "odd") << " parity" << endl;
+    cout << "Initial charge = " << (en0 <= en1 ? n_even : n_odd) << endl;
+    return (en0 <= en1 ? psi0 : psi1);
+}
+
+// Initial state for either representation of the scatterer and of the leads.
+// The product state of get_ground_state_BdG_scatter is the ground state only if every basis is diagonal.
+template <typename BasisL, typename BasisR, typename SiteType, typename Para>
+MPS get_initial_state (const BasisL& leadL, const BasisR& leadR, const BdGBasis& scatterer,
+                       const SiteType& sites, Real muL, Real muR, const Para& para, int maxOcc, const ToGlobDict& to_glob)
+{
+    bool coupled_leads = (offdiag_terms (leadL).size() > 0 or offdiag_terms (leadR).size() > 0);
+    if (scatterer.is_real_space() or coupled_leads)
+        return get_ground_state_by_dmrg (leadL, leadR, scatterer, sites, muL, muR, para, maxOcc, to_glob);
+    else
+        return get_ground_state_BdG_scatter (leadL, leadR, scatterer, sites, muL, muR, para, maxOcc, to_glob);
+}
+
 template <typename BasisL, typename BasisR, typename BasisS, typename BasisC, typename SiteType>
 MPS get_non_inter_ground_state (const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer, const BasisC& charge,
                                 const SiteType& sites, Real muL, Real muS, Real muR, const ToGlobDict& to_glob)
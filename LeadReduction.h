@@ -0,0 +1,64 @@
+#ifndef __LEADREDUCTION_H_CMC__
+#define __LEADREDUCTION_H_CMC__
+#include "OneParticleBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Removal of the lead orbitals that are far from the bias window and weakly coupled to the device.
+//
+// An orbital k couples to the device only through the contact site c, with amplitude tc U(c,k).
+// If it is dropped, to second order in tc it shifts the on-site energy of the device contact site by
+//      tc^2 * sigma,   sigma = sum_k |U(c,k)|^2 / (mu - e_k)
+// for both occupied (e_k < mu) and empty (e_k > mu) orbitals, where mu is the chemical potential of the lead.
+// The shift is added to the Hamiltonian as a term on the device contact site.
+// The error estimate is the perturbative admixture of the dropped orbitals, tc^2 sum_k |U(c,k)|^2 / (mu - e_k)^2,
+// which is the probability that any of them changes its occupation.
+//
+// An orbital is dropped if |e_k - mu| > Ecut and its own admixture is below eps.
+struct LeadReduction
+{
+    vector<int> kept;               // 1-index modes kept
+    int         n_dropped = 0,
+                n_occ     = 0;      // number of dropped occupied orbitals
+    Real        sigma     = 0.,
+                admixture = 0.,     // in units of tc^2
+                E_occ     = 0.;     // energy of the dropped occupied orbitals (constant)
+};
+
+LeadReduction find_inert_orbitals (const OneParticleBasis& lead, int contact_site, Real tc, Real mu, Real Ecut, Real eps)
+{
+    // |U(c,k)|^2
+    vector<Real> w (lead.size()+1, 0.);
+    for(auto const& [k, c, dag] : lead.C_op (contact_site, true))
+        w.at(k) = pow (abs(c), 2);
+
+    LeadReduction red;
+    for(int k = 1; k <= lead.size(); k++)
+    {
+        Real d = mu - lead.en(k);
+        Real a = w.at(k) / (d*d);
+        if (abs(d) > Ecut and tc*tc * a < eps)
+        {
+            red.n_dropped++;
+            red.sigma += w.at(k) / d;
+            red.admixture += a;
+            if (d > 0.)
+            {
+                red.n_occ++;
+                red.E_occ += lead.en(k);
+            }
+        }
+        else
+            red.kept.push_back (k);
+    }
+    return red;
+}
+
+void print_reduction (const string& name, const LeadReduction& red, Real tc)
+{
+    cout << "Lead " << name << ": drop " << red.n_dropped << " inert orbitals (" << red.n_occ << " occupied), keep " << red.kept.size() << endl
+         << "\tcontact energy shift = " << tc*tc * red.sigma
+         << ", admixture (error estimate) = " << tc*tc * red.admixture
+         << ", constant energy = " << red.E_occ << endl;
+}
+#endif
@@ -0,0 +1,246 @@
+#ifndef __LINDBLAD_H_CMC__
+#define __LINDBLAD_H_CMC__
+#include "itensor/all.h"
+#include "tdvp.h"
+#include "basisextension.h"
+#include "MixedBasis.h"
+#include "Hamiltonian.h"
+using namespace itensor;
+using namespace std;
+
+// Open leads: every lead orbital k is coupled to a reservoir at the bias chemical potential of its lead by the Lindblad operators
+//      sqrt(2 Gamma^-_k) C_k,  sqrt(2 Gamma^+_k) Cdag_k,   Gamma^-_k = gamma (1-f_k),  Gamma^+_k = gamma f_k,
+// where f_k is the Fermi function of the orbital energy at the bias chemical potential and temperature T.
+// The orbital energies are en(k) of the lead bases, so the leads must be in the energy basis (not hybrid nor rotated to natural orbitals).
+// The density matrix is evolved to a true steady state, so that the leads need far fewer orbitals than closed leads.
+//
+// The density matrix is vectorized in the superfermion representation: every site j gets a tilde copy, at the MPS sites 2j-1 and 2j,
+// and |rho>> = rho |I> with |I> = prod_j (1 + Cdag_j Cdag~_j) |0> (sum_n |n,n~> for the charge site). Then
+//      rho O |I> = O~ |rho>>,   Tr(A rho) = <I|A|rho>>
+// where O~ is the operator product in the reversed order with C -> Cdag~, Cdag -> -C~ and the bosonic operators transposed,
+// times (-1)^(nf(nf-1)/2) for nf fermionic operators. The Lindblad equation becomes d|rho>>/dt = -i M |rho>> with
+//      M = H - H~ + i sum_k [Gamma^-_k (-2 C_k C~_k - N_k - N~_k) + Gamma^+_k (2 Cdag_k Cdag~_k - 2 + N_k + N~_k)]
+// which is evolved by TDVP with the Arnoldi exponential (NonHermitian).
+// The quantum numbers of the tilde sites are negated, so that M conserves them and |I> has zero flux.
+
+// The site index of the tilde copy of <s>, with negated quantum numbers
+Index tilde_index (const Index& s)
+{
+    auto qns = Index::qnstorage (nblock(s));
+    for(int b = 1; b <= nblock(s); b++)
+        qns.at(b-1) = QNInt (QN() - qn(s,b), blocksize(s,b));
+    return Index (std::move(qns), dir(s), tags(s)).addTags("Tilde");
+}
+
+// Physical site j at 2j-1 and its tilde copy at 2j
+MixedBasis vectorized_sites (const MixedBasis& sites, const Args& args_basis)
+{
+    vector<Index> is;
+    for(int j = 1; j <= length(sites); j++)
+    {
+        is.push_back (sites(j));
+        is.push_back (tilde_index (sites(j)));
+    }
+    return MixedBasis (IndexSet (is), args_basis);
+}
+
+// Tilde image of a single-site operator and its sign
+pair<string,Real> tilde_op (const string& op, bool fermion)
+{
+    if (fermion)
+    {
+        if (op == "C")    return {"Cdag",1.};
+        if (op == "Cdag") return {"C",-1.};
+        if (op == "N" or op == "F" or op == "I") return {op,1.};
+    }
+    else
+    {
+        if (op == "A")     return {"Adag",1.};
+        if (op == "Adag")  return {"A",1.};
+        if (op == "A2")    return {"A2dag",1.};
+        if (op == "A2dag") return {"A2",1.};
+        if (op == "N" or op == "NSqr" or op == "I") return {op,1.};
+    }
+    mycheck (false, "No tilde image for operator "+op);
+    return {};
+}
+
+// Add coef * O (tilde = false) or coef * O~ (tilde = true) to <ampo_v> for every term O of <ampo>
+void add_vectorized_terms (AutoMPO& ampo_v, const AutoMPO& ampo, Cplx coef, bool tilde)
+{
+    auto const& sites = ampo.sites();
+    for(auto const& term : ampo.terms())
+    {
+        HTerm t;
+        t.coef = coef * term.coef;
+        if (!tilde)
+        {
+            for(auto const& st : term.ops)
+                t.ops.emplace_back (st.op, 2*st.i-1);
+        }
+        else
+        {
+            int nf = 0;
+            for(auto it = term.ops.rbegin(); it != term.ops.rend(); ++it)
+            {
+                bool fermion = hasTags (sites(it->i), "Fermion");
+                auto [op, sign] = tilde_op (it->op, fermion);
+                t.ops.emplace_back (op, 2*it->i);
+                t.coef *= sign;
+                if (fermion and (op == "C" or op == "Cdag"))
+                    nf++;
+            }
+            if ((nf*(nf-1)/2) % 2 == 1)
+                t.coef = -t.coef;
+        }
+        ampo_v.add (t);
+    }
+}
+
+inline Real fermi (Real en, Real mu, Real T)
+{
+    if (T == 0.)
+        return (en < mu ? 1. : (en > mu ? 0. : 0.5));
+    return 1. / (exp ((en-mu)/T) + 1.);
+}
+
+// The dissipative part i D of M for all the orbitals of <lead>
+template <typename Basis>
+void add_lead_dissipators (AutoMPO& ampo_v, const Basis& lead, Real mu, Real gamma, Real T, const ToGlobDict& to_glob)
+{
+    int pid = to_glob.part_id (lead.name());
+    for(int k = 1; k <= lead.size(); k++)
+    {
+        int j = to_glob.at (pid,k);
+        Real f = fermi (lead.en(k), mu, T);
+        Real gm = gamma * (1.-f),
+             gp = gamma * f;
+        ampo_v += Cplx(0.,-2.*gm), "C", 2*j-1, "C", 2*j;
+        ampo_v += Cplx(0.,2.*gp), "Cdag", 2*j-1, "Cdag", 2*j;
+        ampo_v += Cplx(0.,gp-gm), "N", 2*j-1;
+        ampo_v += Cplx(0.,gp-gm), "N", 2*j;
+        ampo_v += Cplx(0.,-2.*gp), "I", 2*j;
+    }
+}
+
+// |rho>> of a product state: the lead orbitals below the bias chemical potentials filled, the scatterer empty, no extra charge.
+// The steady state does not depend on the initial state.
+template <typename BasisL, typename BasisR, typename BasisS>
+MPS vectorized_product_state (const MixedBasis& vsites, const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer,
+                              Real muL, Real muR, const ToGlobDict& to_glob)
+{
+    InitState init (vsites);
+    auto set_pair = [&init] (int j, const string& state)
+    {
+        init.set (2*j-1, state);
+        init.set (2*j, state);
+    };
+    auto fill = [&] (const auto& lead, Real mu)
+    {
+        int pid = to_glob.part_id (lead.name());
+        for(int k = 1; k <= lead.size(); k++)
+            set_pair (to_glob.at (pid,k), (lead.en(k) < mu ? "Occ" : "Emp"));
+    };
+    fill (leadL, muL);
+    fill (leadR, muR);
+    int pid = to_glob.part_id (scatterer.name());
+    for(int k = 1; k <= scatterer.size(); k++)
+        set_pair (to_glob.at (pid,k), "Emp");
+    set_pair (to_glob.at (PartC(),1), "0");
+    return MPS (init);
+}
+
+// <I| restricted to the physical site s and its tilde copy st
+ITensor pair_tensor (const Index& s, const Index& st)
+{
+    ITensor T (dag(s), dag(st));
+    for(int n = 1; n <= dim(s); n++)
+        T.set (dag(s)=n, dag(st)=n, 1.);
+    return T;
+}
+
+// <I|A|rho>>; A is an MPO on the vectorized sites
+Cplx vectorized_expect (const MPS& rho, const MPO& A)
+{
+    int N = length(rho);
+    ITensor E;
+    for(int j = 1; j < N; j += 2)
+    {
+        E = (j == 1 ? rho(j) : E * rho(j));
+        E *= A(j);
+        E *= rho(j+1);
+        E *= A(j+1);
+        E.noPrime ("Site");
+        E *= pair_tensor (siteIndex(rho,j), siteIndex(rho,j+1));
+    }
+    return eltC(E);
+}
+
+// <I|rho>> = Tr(rho)
+Cplx vectorized_trace (const MPS& rho)
+{
+    int N = length(rho);
+    ITensor E;
+    for(int j = 1; j < N; j += 2)
+    {
+        E = (j == 1 ? rho(j) : E * rho(j));
+        E *= rho(j+1);
+        E *= pair_tensor (siteIndex(rho,j), siteIndex(rho,j+1));
+    }
+    return eltC(E);
+}
+
+// Evolve the vectorized density matrix with the Hamiltonian <ampoH> and the lead reservoirs,
+// and print the contact currents Tr(I rho) / Tr(rho) at every step
+template <typename BasisL, typename BasisR, typename BasisS>
+void run_lindblad (const AutoMPO& ampoH, const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer,
+                   const MixedBasis& sites, const ToGlobDict& to_glob, const Args& args_basis, Real tcL, Real tcR,
+                   Real muL, Real muR, Real gamma, Real T,
+                   int time_steps, Real dt, const Sweeps& sweeps,
+                   Real hpsi_cutoff, int hpsi_maxdim, int expan_n, int expan_itv,
+                   const Args& args_expansion, Args args_tdvp)
+{
+    auto vsites = vectorized_sites (sites, args_basis);
+
+    AutoMPO ampoM (vsites);
+    add_vectorized_terms (ampoM, ampoH, 1., false);
+    add_vectorized_terms (ampoM, ampoH, -1., true);
+    add_lead_dissipators (ampoM, leadL, muL, gamma, T, to_glob);
+    add_lead_dissipators (ampoM, leadR, muR, gamma, T, to_glob);
+    auto M = toMPO (ampoM);
+    cout << "Liouvillian MPO dim = " << maxLinkDim(M) << endl;
+
+    // Currents through the contacts, from left to right
+    AutoMPO ampo_jL (sites), ampo_jR (sites), ampo_jLv (vsites), ampo_jRv (vsites);
+    add_CdagC (ampo_jL, leadL, scatterer, -1, 1, tcL, to_glob);
+    add_CdagC (ampo_jR, scatterer, leadR, -1, 1, tcR, to_glob);
+    add_vectorized_terms (ampo_jLv, ampo_jL, 1., false);
+    add_vectorized_terms (ampo_jRv, ampo_jR, 1., false);
+    auto jmpoL = toMPO (ampo_jLv),
+         jmpoR = toMPO (ampo_jRv);
+
+    auto rho = vectorized_product_state (vsites, leadL, leadR, scatterer, muL, muR, to_glob);
+    rho.position(1);
+    args_tdvp.add ("NonHermitian",true);
+    LocalMPO PM (M, args_tdvp);
+
+    cout << "Start Lindblad evolution" << endl;
+    for(int step = 1; step <= time_steps; step++)
+    {
+        cout << "step = " << step << endl;
+        if (maxLinkDim(rho) < sweeps.mindim(1) or (step < expan_n and (step-1) % expan_itv == 0))
+        {
+            addBasis (rho, M, hpsi_cutoff, hpsi_maxdim, args_expansion);
+            PM.reset();
+        }
+
+        TDVPWorker (rho, PM, 1_i*dt, sweeps, args_tdvp);
+
+        auto tr = vectorized_trace (rho);
+        auto jL = -2. * imag (vectorized_expect (rho, jmpoL) / tr);
+        auto jR = -2. * imag (vectorized_expect (rho, jmpoR) / tr);
+        cout << "\tI L/R = " << jL << " " << jR << endl;
+        cout << "\tmax dim = " << maxLinkDim(rho) << endl;
+    }
+}
+#endif
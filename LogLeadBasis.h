@@ -0,0 +1,101 @@
+#ifndef __LOGLEADBASIS_H_CMC__
+#define __LOGLEADBASIS_H_CMC__
+#include "OneParticleBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Lead with an energy-dependent discretization (star geometry).
+//
+// A long uniform chain of L_fine sites is diagonalized analytically, and its modes are grouped in energy bins:
+//      uniform bins of width (hi-lo)/n_window inside the bias window [lo,hi],
+//      logarithmic bins outside, with edges at hi + (E_max-hi) Lambda^-n and lo - (lo-E_min) Lambda^-n, n = 0,...,n_log-1.
+// Each bin is replaced by one orbital, the normalized projection of the contact site on the modes in the bin:
+//      |n> = sum_{k in n} U(c,k) |k> / g_n,   g_n^2 = sum_{k in n} U(c,k)^2,   e_n = sum_{k in n} U(c,k)^2 e_k / g_n^2
+// The contact site c is represented exactly, C_c = sum_n g_n C_n.
+// The other stored sites i are projected on the bin orbitals, C_i -> sum_n (sum_{k in n} U(i,k) U(c,k) / g_n) C_n,
+// which is exact only for c. Bins without weight on the contact site are dropped.
+//
+// The result is a OneParticleBasis, so sort_by_energy_charging and add_CdagC work unchanged.
+
+vector<Real> log_bin_edges (Real E_min, Real E_max, Real lo, Real hi, Real Lambda, int n_log, int n_window)
+{
+    mycheck (E_min <= lo and lo <= hi and hi <= E_max, "Bias window outside the band");
+    mycheck (Lambda > 1., "Lambda must be > 1");
+    vector<Real> edges;
+    for(int n = 0; n < n_log; n++)
+        edges.push_back (lo - (lo-E_min) * pow (Lambda, -n));
+    for(int n = 0; n <= n_window; n++)
+        edges.push_back (lo + (hi-lo) * n / max(n_window,1));
+    for(int n = n_log-1; n >= 0; n--)
+        edges.push_back (hi + (E_max-hi) * pow (Lambda, -n));
+    // Make the edges strictly increasing
+    std::sort (edges.begin(), edges.end());
+    edges.erase (std::unique (edges.begin(), edges.end(), [] (Real a, Real b) { return abs(a-b) < 1e-14; }), edges.end());
+    // Include the band edges
+    edges.front() -= 1e-10;
+    edges.back()  += 1e-10;
+    return edges;
+}
+
+// contact_site: the real-space site coupled to the device (1-index; negative counts from the end)
+// keep_sites:   the real-space sites for which C_op is needed (must include contact_site)
+OneParticleBasis log_discretized_lead (const string& name, int L_fine, Real t, Real mu, int contact_site, const vector<int>& keep_sites,
+                                       Real lo, Real hi, Real Lambda, int n_log, int n_window)
+{
+    if (contact_site < 0) contact_site += L_fine+1;
+    vector<int> is;
+    vector<int> rows (L_fine, -1);
+    for(int i : keep_sites)
+    {
+        if (i < 0) i += L_fine+1;
+        mycheck (i > 0 and i <= L_fine, "out of range");
+        if (rows.at(i-1) == -1)
+        {
+            rows.at(i-1) = is.size();
+            is.push_back (i-1);
+        }
+    }
+    mycheck (rows.at(contact_site-1) != -1, "keep_sites must include the contact site");
+    int rc = rows.at(contact_site-1);
+
+    auto [ens_fine, U_fine] = tridiag_eigen_uniform (L_fine, -mu, -t, is);
+    Real E_min = -mu - 2.*abs(t),
+         E_max = -mu + 2.*abs(t);
+    auto edges = log_bin_edges (E_min, E_max, max(lo,E_min), min(hi,E_max), Lambda, n_log, n_window);
+    int nbin = edges.size()-1;
+
+    // Accumulate the bins
+    vector<Real> g2 (nbin, 0.), eg (nbin, 0.);
+    vector<vector<Real>> proj (is.size(), vector<Real> (nbin, 0.));
+    for(int k = 0; k < L_fine; k++)
+    {
+        Real e = ens_fine(k);
+        int n = std::upper_bound (edges.begin(), edges.end(), e) - edges.begin() - 1;
+        n = max (0, min (n, nbin-1));
+        Real uc = U_fine(rc,k);
+        g2.at(n) += uc*uc;
+        eg.at(n) += uc*uc * e;
+        for(int r = 0; r < is.size(); r++)
+            proj.at(r).at(n) += U_fine(r,k) * uc;
+    }
+
+    // Keep the bins with weight; order by descending energy, the same as the other bases
+    vector<int> bins;
+    for(int n = nbin-1; n >= 0; n--)
+        if (g2.at(n) > 1e-14)
+            bins.push_back (n);
+    int M = bins.size();
+    Vector ens (M);
+    Matrix U (is.size(), M);
+    for(int j = 0; j < M; j++)
+    {
+        int n = bins.at(j);
+        Real g = sqrt (g2.at(n));
+        ens(j) = eg.at(n) / g2.at(n);
+        for(int r = 0; r < is.size(); r++)
+            U(r,j) = proj.at(r).at(n) / g;
+    }
+    cout << "Log-discretized lead " << name << ": " << L_fine << " sites -> " << M << " orbitals" << endl;
+    return OneParticleBasis (name, ens, U, rows, mu);
+}
+#endif
@@ -0,0 +1,138 @@
+#ifndef __MPOCACHE_H_CMC__
+#define __MPOCACHE_H_CMC__
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <unistd.h>
+#include "itensor/all.h"
+#include "ReadWriteFile.h"
+#include "SortBasis.h"
+using namespace itensor;
+using namespace std;
+
+// On-disk cache of the Hamiltonian MPO.
+// The key is built from the physical parameters and the orbital ordering (to_loc),
+// so two jobs with the same Hamiltonian share the same file.
+// The ordering is known only after the bases are built, so a hit saves only toMPO; the file holds the MPO
+// and the orbital dictionaries to check the ordering, not the bases.
+
+// Key in text form. The full text is stored in the file to guard against hash collisions.
+string hamilt_cache_key (const vector<pair<string,Real>>& real_paras,
+                         const vector<pair<string,int>>& int_paras,
+                         const ToLocDict& to_loc)
+{
+    ostringstream oss;
+    oss << setprecision(17);
+    // Files of the older format, which also held the bases, get different keys
+    oss << "format=2;";
+    for(auto const& [name, val] : real_paras)
+        oss << name << "=" << val << ";";
+    for(auto const& [name, val] : int_paras)
+        oss << name << "=" << val << ";";
+    // to_loc is 1-index; to_loc[0] is empty
+    oss << "orbs=";
+    for(int i = 1; i < to_loc.size(); i++)
+    {
+        auto const& [p, k] = to_loc.at(i);
+        oss << p << k << ",";
+    }
+    return oss.str();
+}
+
+// FNV-1a 64-bit hash
+string hamilt_cache_hash (const string& key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(unsigned char c : key)
+    {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    ostringstream oss;
+    oss << hex << setw(16) << setfill('0') << h;
+    return oss.str();
+}
+
+string hamilt_cache_file (const string& cache_dir, const string& key)
+{
+    return cache_dir + "/H_" + hamilt_cache_hash (key) + ".mpo";
+}
+
+// Check two site indices are the same up to their IDs: dimension, tags, direction and QN blocks
+bool same_site_structure (const Index& i1, const Index& i2)
+{
+    if (dim(i1) != dim(i2)) return false;
+    if (tags(i1) != tags(i2)) return false;
+    if (dir(i1) != dir(i2)) return false;
+    if (hasQNs(i1) != hasQNs(i2)) return false;
+    if (hasQNs(i1))
+    {
+        if (nblock(i1) != nblock(i2)) return false;
+        for(int b = 1; b <= nblock(i1); b++)
+        {
+            if (qn(i1,b) != qn(i2,b)) return false;
+            if (blocksize(i1,b) != blocksize(i2,b)) return false;
+        }
+    }
+    return true;
+}
+
+// Replace the site indices of H by those of <sites>.
+// The indices stored in a file have different IDs from the ones created in this run,
+// so they are checked structurally and then relabelled.
+template <typename SiteType>
+void attach_sites (MPO& H, const SiteType& sites)
+{
+    mycheck (length(H) == length(sites), "MPO length does not match the SiteSet");
+    for(int i = 1; i <= length(H); i++)
+    {
+        auto is_old = findIndex (H(i), "Site,0");
+        auto is_new = sites(i);
+        mycheck (same_site_structure (is_old, is_new), "Cached MPO site index does not match MixedBasis at site "+to_string(i));
+        H.ref(i).replaceInds ({is_old, prime(is_old)}, {is_new, prime(is_new)});
+    }
+}
+
+void write_hamilt_cache (const string& filename, const string& key, const MPO& H,
+                         const ToGlobDict& to_glob, const ToLocDict& to_loc)
+{
+    // Write to a temporary file first so that a concurrent job never reads a partial file
+    string tmpfile = filename + ".tmp" + to_string (getpid());
+    {
+        ofstream ofs (tmpfile, ios::binary);
+        itensor::write (ofs, key);
+        itensor::write (ofs, H);
+        iut::write (ofs, to_glob);
+        iut::write (ofs, to_loc);
+    }
+    std::rename (tmpfile.c_str(), filename.c_str());
+}
+
+// Return false if the file does not exist or was written for a different key
+template <typename SiteType>
+bool read_hamilt_cache (const string& filename, const string& key, const SiteType& sites, MPO& H,
+                        const ToGlobDict& to_glob, const ToLocDict& to_loc)
+{
+    ifstream ifs (filename, ios::binary);
+    if (!ifs.good())
+        return false;
+
+    string key_file;
+    itensor::read (ifs, key_file);
+    if (key_file != key)
+    {
+        cout << "Hamiltonian cache: hash collision in " << filename << "; ignore the cache" << endl;
+        return false;
+    }
+    itensor::read (ifs, H);
+    ToGlobDict to_glob_file;
+    ToLocDict to_loc_file;
+    iut::read (ifs, to_glob_file);
+    iut::read (ifs, to_loc_file);
+    mycheck (to_glob_file == to_glob and to_loc_file == to_loc, "Cached orbital ordering does not match");
+
+    attach_sites (H, sites);
+    return true;
+}
+#endif
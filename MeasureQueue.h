@@ -0,0 +1,109 @@
+#ifndef __MEASUREQUEUE_H_CMC__
+#define __MEASUREQUEUE_H_CMC__
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <deque>
+#include <iostream>
+using namespace std;
+
+// Measurements which only read the MPS, run on a worker thread while the main thread goes on with the next time steps.
+// A job gets its own copy of the MPS: ITensor copies share the storage, and ITensor copies the storage
+// before it is modified, so the copy is cheap and is not affected by the time evolution.
+// A job must not create new Index objects (position(), SVD, QR, innerC, ...): ITensor draws their IDs from a global generator
+// which the main thread uses at the same time. Gauge the MPS before push() and use plain contractions such as BatchExpect.
+// Beyond that the worker relies on the internal thread-safety of ITensor (shared copy-on-write storage, allocation), which has not
+// been verified, so async stays off by default.
+// The jobs run one at a time in the order of push(), and their output is printed by the main thread in the same order.
+// At most max_pending jobs wait or run at a time: push() first prints the oldest results, waiting for them if needed,
+// so that the copies of the MPS do not pile up when the jobs are slower than the time steps.
+// Without the worker (async = false) the jobs run and print immediately.
+class MeasureQueue
+{
+    public:
+        using Job = std::function<string()>;        // returns the text to print
+
+        MeasureQueue (bool async=false, int max_pending=2)
+        : _max_pending (max_pending)
+        {
+            if (async)
+                _worker = std::thread ([this] { work(); });
+        }
+
+        ~MeasureQueue ()
+        {
+            print (true);
+            if (_worker.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock (_mutex);
+                    _stop = true;
+                }
+                _cv.notify_one();
+                _worker.join();
+            }
+        }
+
+        void push (Job job)
+        {
+            if (!_worker.joinable())
+            {
+                cout << job() << flush;
+                return;
+            }
+            while (_results.size() >= _max_pending)
+            {
+                cout << _results.front().get() << flush;
+                _results.pop_front();
+            }
+            std::packaged_task<string()> task (std::move(job));
+            _results.push_back (task.get_future());
+            {
+                std::lock_guard<std::mutex> lock (_mutex);
+                _jobs.push_back (std::move(task));
+            }
+            _cv.notify_one();
+        }
+
+        // Print the output of the finished jobs; with <wait>, of all the jobs
+        void print (bool wait=false)
+        {
+            while (_results.size() > 0)
+            {
+                auto& f = _results.front();
+                if (!wait and f.wait_for (std::chrono::seconds(0)) != std::future_status::ready)
+                    break;
+                cout << f.get() << flush;
+                _results.pop_front();
+            }
+        }
+
+    private:
+        std::thread                            _worker;
+        std::mutex                             _mutex;
+        std::condition_variable                _cv;
+        std::deque<std::packaged_task<string()>> _jobs;
+        std::deque<std::future<string>>        _results;
+        bool                                   _stop=false;
+        int                                    _max_pending=2;
+
+        void work ()
+        {
+            while (true)
+            {
+                std::packaged_task<string()> task;
+                {
+                    std::unique_lock<std::mutex> lock (_mutex);
+                    _cv.wait (lock, [this] { return _stop or _jobs.size() > 0; });
+                    if (_jobs.size() == 0)
+                        return;
+                    task = std::move (_jobs.front());
+                    _jobs.pop_front();
+                }
+                task();
+            }
+        }
+};
+#endif
@@ -8,17 +8,20 @@ using namespace itensor;
 
 class MixedBasis : public SiteSet
 {
-    int _maxOcc;
+    int _maxOcc, _minCharge;
 
     public:
 
     int maxOcc () const { return _maxOcc; }
+    // Charge of the i-th state (1-index) of the charge site
+    int charge (int i) const { return _minCharge + i - 1; }
 
     MixedBasis() {}
 
     MixedBasis (int N, int iL, int iR, int iC, Args const& args=Args::global())
     {
         _maxOcc = args.getInt("MaxOcc");
+        _minCharge = args.getInt("MinCharge",-_maxOcc);
         auto sites = SiteStore(N);
         for(int j = 1; j <= N; ++j)
         {
@@ -32,6 +35,7 @@ class MixedBasis : public SiteSet
     MixedBasis (int N, const vector<int>& scatter_sites, int iC, Args const& args=Args::global())
     {
         _maxOcc = args.getInt("MaxOcc");
+        _minCharge = args.getInt("MinCharge",-_maxOcc);
         auto sites = SiteStore(N);
         for(int j = 1; j <= N; ++j)
         {
@@ -44,6 +48,9 @@ class MixedBasis : public SiteSet
 
     MixedBasis (IndexSet const& is, Args const& args=Args::global())
     {
+        // The charge site may hold only a window of the charges, so its dimension does not give MaxOcc
+        _maxOcc = args.getInt("MaxOcc");
+        _minCharge = args.getInt("MinCharge",-_maxOcc);
         int N = is.length();
         auto sites = SiteStore(N);
         for(auto j : range1(N))
@@ -52,9 +59,8 @@ class MixedBasis : public SiteSet
             mycheck (hasTags(ii,"Boson") or hasTags(ii,"Fermion"), "unknown site index");
             if (hasTags(ii,"Boson"))
             {
+                mycheck (_minCharge + dim(ii) - 1 <= _maxOcc, "charge site larger than MaxOcc");
                 sites.set(j,SpecialBosonSite(ii,args));
-                int d = dim(ii);
-                _maxOcc = (d-1)/2;
             }
             else
                 sites.set(j,SpecialFermionSite(ii));
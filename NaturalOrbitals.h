@@ -0,0 +1,234 @@
+#ifndef __NATURALORBITALS_H_CMC__
+#define __NATURALORBITALS_H_CMC__
+#include "itensor/all.h"
+#include "Reorder.h"
+#include "Correlation.h"
+#include "OneParticleBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Rotation of a lead basis to its natural orbitals during the time evolution.
+//
+// The correlation matrix rho_kk' = <Cdag_k C_k'> of the lead orbitals is measured in the MPS,
+// and the orbitals are rotated to the eigenvectors W of Re(rho), d_m = sum_k W(k,m) C_k.
+// Each eigenvector is matched to the old orbital it overlaps most, so that the MPS sites keep their orbitals
+// and W is close to the identity.
+//
+// W is real so that the bases, and with them the Hamiltonian MPO, stay real. Im(rho) carries the currents;
+// it is antisymmetric and stays off-diagonal under any real rotation, so it is not removed.
+// The off-diagonal norm of rho before and after the rotation is printed, with the bond dimension of the MPS,
+// and the rotation is skipped if it does not reduce the off-diagonal norm.
+//
+// The MPS is transformed by the Gaussian unitary U with U Cdag_k U^dag = sum_m W(k,m) Cdag_m.
+// W^T is decomposed into Givens rotations between orbitals neighboring in the MPS, which are applied as two-site gates
+// with SVD truncation; orbitals separated by other sites are brought together by swap gates and moved back.
+// The sum of the discarded weights of the gates and the swaps is printed.
+
+// rho_ij = <Cdag_i C_j> for the fermionic sites <js> (ascending), as its real and imaginary parts
+template <typename SiteType>
+pair<Matrix,Matrix> CdagC_matrix (const MPS& psi, const SiteType& sites, const vector<int>& js, int nthreads=1)
+{
+    auto rho_c = correlation_matrices (psi, sites, js, {}, nthreads).first;
+    int n = js.size();
+    Matrix re (n,n), im (n,n);
+    for(int a = 0; a < n; a++)
+        for(int b = 0; b < n; b++)
+        {
+            re(a,b) = rho_c(a,b).real();
+            im(a,b) = rho_c(a,b).imag();
+        }
+    return {re, im};
+}
+
+// Norm of the off-diagonal part of W^T rho W, rho = re + i im
+Real offdiag_norm (const Matrix& re, const Matrix& im, const Matrix& W)
+{
+    Matrix re2 = transpose(W) * re * W,
+           im2 = transpose(W) * im * W;
+    Real s = 0.;
+    for(int a = 0; a < nrows(re2); a++)
+        for(int b = 0; b < ncols(re2); b++)
+            if (a != b)
+                s += re2(a,b) * re2(a,b) + im2(a,b) * im2(a,b);
+    return sqrt(s);
+}
+
+// Eigenvectors of rho as the columns of W, column m matched to orbital m with W(m,m) > 0
+Matrix natural_orbital_rotation (const Matrix& rho)
+{
+    int n = nrows(rho);
+    Matrix V;
+    Vector occ;
+    diagHermitian (rho, V, occ);
+
+    // Greedy matching by the largest overlaps
+    vector<tuple<Real,int,int>> overlaps;      // |V(m,j)|, m, j
+    for(int m = 0; m < n; m++)
+        for(int j = 0; j < n; j++)
+            overlaps.emplace_back (abs(V(m,j)), m, j);
+    std::sort (overlaps.begin(), overlaps.end(), [] (const auto& a, const auto& b) { return get<0>(a) > get<0>(b); });
+    vector<bool> used_m (n,false), used_j (n,false);
+    Matrix W (n,n);
+    for(auto const& [ov, m, j] : overlaps)
+    {
+        if (used_m.at(m) or used_j.at(j)) continue;
+        used_m.at(m) = used_j.at(j) = true;
+        Real sign = (V(m,j) < 0. ? -1. : 1.);
+        column (W,m) &= sign * column (V,j);
+    }
+    return W;
+}
+
+// Givens rotations (p, c, s) with O = G_1 ... G_L D, where G acts on the rows p, p+1 as [[c,-s],[s,c]]
+// and D = diag(<signs>) is +-1 for an orthogonal O
+vector<tuple<int,Real,Real>> givens_decomposition (Matrix O, vector<Real>& signs)
+{
+    int n = nrows(O);
+    vector<tuple<int,Real,Real>> gs;
+    // Zero the lower triangle column by column from the bottom; each step is O <- G^T O
+    for(int col = 0; col < n-1; col++)
+        for(int q = n-1; q > col; q--)
+        {
+            int p = q-1;
+            Real x = O(p,col),
+                 y = O(q,col);
+            if (abs(y) < 1e-15) continue;
+            Real r = sqrt (x*x + y*y),
+                 c = x / r,
+                 s = y / r;
+            for(int j = 0; j < n; j++)
+            {
+                Real op = O(p,j),
+                     oq = O(q,j);
+                O(p,j) =  c * op + s * oq;
+                O(q,j) = -s * op + c * oq;
+            }
+            gs.emplace_back (p, c, s);
+        }
+    signs.resize (n);
+    for(int j = 0; j < n; j++)
+        signs.at(j) = (O(j,j) < 0. ? -1. : 1.);
+    return gs;
+}
+
+// U for the modes of the fermionic sites s1 (left) and s2 with U Cdag_1 U^dag = c Cdag_1 + s Cdag_2
+// and U Cdag_2 U^dag = -s Cdag_1 + c Cdag_2, i.e. the Givens rotation [[c,-s],[s,c]]
+ITensor givens_gate (const Index& s1, const Index& s2, Real c, Real s)
+{
+    auto G = ITensor (dag(s1), dag(s2), prime(s1), prime(s2));
+    G.set (s1=1, s2=1, prime(s1)=1, prime(s2)=1, 1.);
+    G.set (s1=2, s2=2, prime(s1)=2, prime(s2)=2, 1.);
+    G.set (s1=2, s2=1, prime(s1)=2, prime(s2)=1, c);
+    G.set (s1=2, s2=1, prime(s1)=1, prime(s2)=2, s);
+    G.set (s1=1, s2=2, prime(s1)=2, prime(s2)=1, -s);
+    G.set (s1=1, s2=2, prime(s1)=1, prime(s2)=2, c);
+    return G;
+}
+
+// Apply the gate G on the sites b and b+1 of psi. The orthogonality center ends at b+1.
+// Return the spectrum of the SVD, which has the discarded weight.
+Spectrum apply_two_site_gate (MPS& psi, int b, const ITensor& G, const Args& args)
+{
+    psi.position(b);
+    auto phi = psi(b) * psi(b+1) * G;
+    phi.noPrime ("Site");
+    auto s1 = findIndex (psi(b), "Site");
+    IndexSet uinds;
+    if (b > 1)
+        uinds = IndexSet (leftLinkIndex (psi,b), s1);
+    else
+        uinds = IndexSet (s1);
+    ITensor U (uinds), S, V;
+    auto spec = svd (phi, U, S, V, args);
+    psi.ref(b) = U;
+    psi.ref(b+1) = S*V;
+    psi.leftLim (b);
+    psi.rightLim (b+2);
+    return spec;
+}
+
+// Rotate the lead <basis> to its natural orbitals and transform psi accordingly.
+// <args> are the truncation parameters of the gates (Cutoff, MaxDim).
+// Return false if the rotation is skipped.
+template <typename SiteType>
+bool rotate_to_natural_orbitals (MPS& psi, OneParticleBasis& basis, const SiteType& sites, const ToGlobDict& to_glob, const Args& args)
+{
+    // Sites of the lead in the MPS, in ascending order
+    int pid = to_glob.part_id (basis.name());
+    vector<pair<int,int>> jk;       // MPS site, orbital
+    for(int k = 1; k <= basis.size(); k++)
+        jk.emplace_back (to_glob.at (pid,k), k);
+    std::sort (jk.begin(), jk.end());
+    vector<int> js;
+    for(auto [j, k] : jk)
+        js.push_back (j);
+
+    // Correlation matrix in the orbital order
+    Matrix re_js, im_js;
+    tie (re_js, im_js) = CdagC_matrix (psi, sites, js);
+    int n = js.size();
+    Matrix re (n,n), im (n,n), Id (n,n);
+    for(int a = 0; a < n; a++)
+    {
+        Id(a,a) = 1.;
+        for(int b = 0; b < n; b++)
+        {
+            re(jk[a].second-1, jk[b].second-1) = re_js(a,b);
+            im(jk[a].second-1, jk[b].second-1) = im_js(a,b);
+        }
+    }
+
+    auto W = natural_orbital_rotation (re);
+    Real off_old = offdiag_norm (re, im, Id),
+         off_new = offdiag_norm (re, im, W);
+    cout << "\tnatural orbitals of " << basis.name() << ": off-diagonal |rho| = " << off_old << " -> " << off_new
+         << ", |Im rho| = " << norm(im) << endl;
+    if (off_new >= off_old)
+    {
+        cout << "\tnatural orbitals of " << basis.name() << ": no gain, skip" << endl;
+        return false;
+    }
+
+    // W^T in the MPS order of the orbitals
+    Matrix O (n,n);
+    for(int a = 0; a < n; a++)
+        for(int b = 0; b < n; b++)
+            O(a,b) = W(jk[b].second-1, jk[a].second-1);
+    vector<Real> signs;
+    auto gs = givens_decomposition (O, signs);
+
+    int dim_old = maxLinkDim (psi);
+    Real discarded = 0.;
+    // U = U(G_1) ... U(G_L) U(D): the signs first, then the Givens rotations from the last one
+    for(int a = 0; a < n; a++)
+    {
+        if (signs.at(a) > 0.) continue;
+        int j = js.at(a);
+        auto s = findIndex (psi(j), "Site");
+        auto F = ITensor (dag(s), prime(s));
+        F.set (s=1, prime(s)=1, 1.);
+        F.set (s=2, prime(s)=2, -1.);
+        psi.ref(j) *= F;
+        psi.ref(j).noPrime ("Site");
+    }
+    for(int i = gs.size()-1; i >= 0; i--)
+    {
+        auto [p, c, s] = gs.at(i);
+        int j1 = js.at(p),
+            j2 = js.at(p+1);
+        // Bring the orbital at j2 next to j1, apply the gate, and move it back
+        for(int b = j2-1; b > j1; b--)
+            discarded += swap_sites (psi, b, args).truncerr();
+        auto G = givens_gate (findIndex (psi(j1), "Site"), findIndex (psi(j1+1), "Site"), c, s);
+        discarded += apply_two_site_gate (psi, j1, G, args).truncerr();
+        for(int b = j1+1; b < j2; b++)
+            discarded += swap_sites (psi, b, args).truncerr();
+    }
+    psi.normalize();
+
+    basis.rotate (W);
+    cout << "\tnatural orbitals of " << basis.name() << ": " << gs.size() << " Givens gates, discarded weight = " << discarded
+         << ", MPS max dim = " << dim_old << " -> " << maxLinkDim(psi) << endl;
+    return true;
+}
+#endif
@@ -0,0 +1,121 @@
+#ifndef __OBSSTORE_H_CMC__
+#define __OBSSTORE_H_CMC__
+#include <fstream>
+#include <limits>
+#include <map>
+#include "itensor/all.h"
+using namespace itensor;
+using namespace std;
+
+// Binary columnar store of the observables of every time step, read by obsstore.py with np.memmap.
+//
+// Every column <name> is the file <dir>/<name>.bin of float64 rows with a fixed number of values, in the native byte order.
+// The row of a step is step-1, so that a run restarted from a checkpoint continues the files;
+// rows skipped by write() are filled with NaN. <dir>/meta.txt lists the columns ("column <name> <ncols>")
+// and the parameters given by set_meta() ("<key> <value>"). The directory must exist.
+// In append mode the widths of the columns must match those in the existing meta.txt, e.g. the number of sites of a restarted run.
+class ObsStore
+{
+    public:
+        ObsStore () {}
+        // append: keep the rows already in the files
+        ObsStore (const string& dir, bool append=false);
+
+        bool on () const { return _dir != ""; }
+
+        void add_column (const string& name, int ncols);
+
+        template <typename T>
+        void set_meta (const string& key, const T& val)
+        {
+            ostringstream os;
+            os << setprecision(14) << val;
+            _meta[key] = os.str();
+            write_meta ();
+        }
+
+        void write (const string& name, int step, const vector<Real>& row);
+
+        // At the end of every step, so that the files always hold complete rows
+        void flush ()
+        {
+            for(auto& [name, c] : _cols)
+                c.fs.flush();
+        }
+
+    private:
+        struct Column
+        {
+            int     ncols=0;
+            long    rows=0;
+            fstream fs;
+        };
+        string              _dir;
+        bool                _append=false;
+        map<string,Column>  _cols;
+        map<string,string>  _meta;
+        map<string,int>     _old_ncols;     // widths of the columns in the existing files (append mode)
+
+        void write_meta () const
+        {
+            ofstream ofs (_dir+"/meta.txt");
+            for(auto const& [key, val] : _meta)
+                ofs << key << " " << val << endl;
+            for(auto const& [name, c] : _cols)
+                ofs << "column " << name << " " << c.ncols << endl;
+        }
+};
+
+ObsStore :: ObsStore (const string& dir, bool append)
+: _dir (dir)
+, _append (append)
+{
+    if (!append or dir == "") return;
+    ifstream ifs (_dir+"/meta.txt");
+    string key, name;
+    while (ifs >> key)
+    {
+        if (key == "column")
+            ifs >> name >> _old_ncols[name];
+        else
+            ifs >> name;
+    }
+}
+
+void ObsStore :: add_column (const string& name, int ncols)
+{
+    string fname = _dir+"/"+name+".bin";
+    if (_append and _old_ncols.count(name) > 0)
+        mycheck (_old_ncols.at(name) == ncols, "column "+name+": width "+to_string(ncols)+" does not match the existing "+to_string(_old_ncols.at(name)));
+    auto& c = _cols[name];
+    c.ncols = ncols;
+    if (!_append)
+        c.fs.open (fname, ios::out | ios::trunc | ios::binary);
+    else
+        c.fs.open (fname, ios::out | ios::app | ios::binary);       // create the file if it does not exist
+    c.fs.close();
+    c.fs.open (fname, ios::in | ios::out | ios::binary);
+    mycheck (c.fs.is_open(), "Cannot open "+fname);
+    c.fs.seekp (0, ios::end);
+    c.rows = long(c.fs.tellp()) / (sizeof(Real) * ncols);
+    write_meta ();
+}
+
+void ObsStore :: write (const string& name, int step, const vector<Real>& row)
+{
+    auto& c = _cols.at(name);
+    mycheck (row.size() == c.ncols, "size not match: "+name);
+    long r = step-1;
+    auto row_size = sizeof(Real) * c.ncols;
+    if (r > c.rows)
+    {
+        vector<Real> nans (c.ncols, numeric_limits<Real>::quiet_NaN());
+        c.fs.seekp (c.rows * row_size);
+        for(; c.rows < r; c.rows++)
+            c.fs.write (reinterpret_cast<const char*>(nans.data()), row_size);
+    }
+    c.fs.seekp (r * row_size);
+    c.fs.write (reinterpret_cast<const char*>(row.data()), row_size);
+    c.rows = max (c.rows, r+1);
+}
+#endif
@@ -2,24 +2,38 @@
 #define __ONEPARTICLEBASIS_H_CMC__
 #include "itensor/all.h"
 #include "GeneralUtility.h"
+#include "COpTable.h"
+#include "TridiagEigen.h"
 using namespace itensor;
 using namespace std;
 
+// Hoppings t_i between site i and i+1 (0-index) of a tight-binding chain
+vector<Real> tight_binding_hoppings (int L, Real t, Real damp_fac=1., bool damp_from_right=true, bool verbose=false)
+{
+    vector<Real> ts;
+    for(int i = 0; i < L-1; i++)
+    {
+        int damp_dist = (damp_from_right ? L-2-i : i);
+        Real ti = t * pow (damp_fac, damp_dist);
+        ts.push_back (ti);
+        if (verbose)
+            cout << "Hk, t " << i << " = " << ti << endl;
+    }
+    return ts;
+}
+
 Matrix tight_binding_Hamilt (int L, Real t, Real mu, Real damp_fac=1., bool damp_from_right=true, bool verbose=false)
 {
     cout << "L = " << L << endl;
+    auto ts = tight_binding_hoppings (L, t, damp_fac, damp_from_right, verbose);
     Matrix H (L,L);
     for(int i = 0; i < L; i++)
     {
         H(i,i) = -mu;
         if (i != L-1)
         {
-            int damp_dist = (damp_from_right ? L-2-i : i);
-            Real ti = t * pow (damp_fac, damp_dist);
-            H(i,i+1) = -ti;
-            H(i+1,i) = -ti;
-            if (verbose)
-                cout << "Hk, t " << i << " = " << ti << endl;
+            H(i,i+1) = -ts.at(i);
+            H(i+1,i) = -ts.at(i);
         }
     }
     return H;
@@ -31,66 +45,251 @@ class OneParticleBasis
         OneParticleBasis () {}
         OneParticleBasis (const string& name, const Matrix& H)
         : _name (name)
-        , _H (H)
         {
             diagHermitian (H, _Uik, _ens);
+            set_diag (H);
+            keep_all_sites ();
+            make_C_table ();
         }
         OneParticleBasis (const string& name, int L, Real t, Real mu, Real damp_fac=1., bool damp_from_right=true, bool verbose=false)
         : _name (name)
         {
-            _H = tight_binding_Hamilt (L, t, mu, damp_fac, damp_from_right, verbose);
-            diagHermitian (_H, _Uik, _ens);
+            auto H = tight_binding_Hamilt (L, t, mu, damp_fac, damp_from_right, verbose);
+            diagHermitian (H, _Uik, _ens);
+            set_diag (H);
+            keep_all_sites ();
+            make_C_table ();
+        }
+        // Tight-binding chain without the dense L x L matrix.
+        // solver: "Dense", "Tridiagonal" (MRRR), "Analytic" (sine modes, only for damp_fac = 1), or
+        //         "Auto" (Analytic if damp_fac = 1, otherwise Tridiagonal)
+        // keep_sites: the real-space sites (1-index; negative counts from the end) for which C_op is needed.
+        //             Only these rows of U are stored.
+        OneParticleBasis (const string& name, int L, Real t, Real mu, Real damp_fac, bool damp_from_right, bool verbose,
+                          const string& solver, const vector<int>& keep_sites);
+        // Basis given directly by the mode energies <ens> and the stored rows of U,
+        // U_rows(r,k) = <i|k> for the real-space sites i with rows[i-1] = r (rows[i-1] = -1 if not stored)
+        OneParticleBasis (const string& name, const Vector& ens, const Matrix& U_rows, const vector<int>& rows, Real mu)
+        : _name (name)
+        , _Uik (U_rows)
+        , _ens (ens)
+        , _Hdiag (ens.size())
+        , _rows (rows)
+        {
+            for(int k = 0; k < ens.size(); k++)
+                _Hdiag(k) = -mu;
+            make_C_table ();
         }
         OneParticleBasis (const string& name, int L)
         : _name (name)
         {
-            _H = Matrix(L,L);
-            diagHermitian (_H, _Uik, _ens);
+            auto H = Matrix(L,L);
+            diagHermitian (H, _Uik, _ens);
+            set_diag (H);
+            keep_all_sites ();
+            make_C_table ();
         }
 
         // Functions that every basis class must have
         const string&                name   ()                const { return _name; }
-        vector<tuple<int,auto,bool>> C_op   (int i, bool dag) const;
+        COpRow<Real>                 C_op   (int i, bool dag) const;
         Real                         en     (int k)           const { mycheck (k > 0 and k <= _ens.size(), "out of range"); return _ens(k-1); }
-        Real                         mu     (int k)           const { mycheck (k > 0 and k <= _ens.size(), "out of range"); return -_H(k-1,k-1); }
+        Real                         mu     (int k)           const { mycheck (k > 0 and k <= _ens.size(), "out of range"); return -_Hdiag(k-1); }
         int                          size   ()                const { return _ens.size(); }
+        // Number of real-space sites; negative site indices count from here
+        int                          n_sites()                const { return _rows.size(); }
+
+        // Basis of the modes <ks> only (1-index, in the order given)
+        OneParticleBasis sub_basis (const vector<int>& ks) const;
+
+        // Change to the modes |m> = sum_k W(k,m) |k>, W orthogonal.
+        // The Hamiltonian is no longer diagonal: en(m) is the diagonal element and the rest is given by offdiag_terms.
+        void rotate (const Matrix& W);
+        // Set the Hamiltonian in the modes; en(k) becomes Hk(k-1,k-1)
+        void set_mode_hamilt (const Matrix& Hk);
+        // (k1, k2, h) for the terms h Cdag_k1 C_k2 with k1 != k2 (1-index); empty if the basis is not rotated
+        vector<tuple<int,int,Real>> offdiag_terms (Real cutoff=1e-14) const;
 
         void write (ostream& s) const
         {
             itensor::write(s,_name);
             itensor::write(s,_Uik);
             itensor::write(s,_ens);
+            itensor::write(s,_Hdiag);
+            itensor::write(s,_rows);
+            itensor::write(s,_Hk);
         }
         void read (istream& s)
         {
             itensor::read(s,_name);
             itensor::read(s,_Uik);
             itensor::read(s,_ens);
+            itensor::read(s,_Hdiag);
+            itensor::read(s,_rows);
+            itensor::read(s,_Hk);
+            make_C_table ();
         }
 
     private:
+        void set_diag       (const Matrix& H);
+        void keep_all_sites ();
+        void make_C_table   ();
+
         string _name;
-        Matrix _Uik, _H;
-        Vector _ens;
+        // _Uik(r,k) = <i|k> for the stored sites i; _rows[i-1] is the row r of site i, or -1 if not stored
+        Matrix      _Uik;
+        Vector      _ens, _Hdiag;
+        vector<int> _rows;
+        // Hamiltonian in the modes after rotate; empty if diagonal (_ens)
+        Matrix      _Hk;
+        COpTable<Real> _C_table;
 };
 
-// Get the operator information in this basis for the operator Cdag_i, where i is the real-space site index.
-// i is 1-index
-vector<tuple<int,auto,bool>> OneParticleBasis :: C_op (int i, bool dag) const
+OneParticleBasis :: OneParticleBasis (const string& name, int L, Real t, Real mu, Real damp_fac, bool damp_from_right, bool verbose,
+                                      const string& solver, const vector<int>& keep_sites)
+: _name (name)
+{
+    if (solver == "Dense")
+    {
+        *this = OneParticleBasis (name, L, t, mu, damp_fac, damp_from_right, verbose);
+        return;
+    }
+
+    cout << "L = " << L << endl;
+    auto ts = tight_binding_hoppings (L, t, damp_fac, damp_from_right, verbose);
+
+    // Rows to store
+    _rows = vector<int> (L, -1);
+    vector<int> is;
+    for(int i : keep_sites)
+    {
+        if (i < 0) i += L+1;
+        mycheck (i > 0 and i <= L, "out of range");
+        if (_rows.at(i-1) == -1)
+        {
+            _rows.at(i-1) = is.size();
+            is.push_back (i-1);
+        }
+    }
+
+    if (solver == "Analytic" or (solver == "Auto" and damp_fac == 1.))
+    {
+        mycheck (damp_fac == 1., "Analytic solver only for uniform chains");
+        tie (_ens, _Uik) = tridiag_eigen_uniform (L, -mu, -t, is);
+    }
+    else if (solver == "Tridiagonal" or solver == "Auto")
+    {
+        vector<Real> d (L, -mu), e;
+        for(auto ti : ts)
+            e.push_back (-ti);
+        tie (_ens, _Uik) = tridiag_eigen_MRRR (d, e, is);
+    }
+    else
+        mycheck (false, "Unknown solver: "+solver);
+    _Hdiag = Vector (L);
+    for(int i = 0; i < L; i++)
+        _Hdiag(i) = -mu;
+    make_C_table ();
+}
+
+COpRow<Real> OneParticleBasis :: C_op (int i, bool dag) const
 {
-    mycheck (i > 0 and i <= nrows(_Uik), "out of range");
+    mycheck (i > 0 and i <= _rows.size(), "out of range");
+    mycheck (_rows.at(i-1) >= 0, "C_op for site "+to_string(i)+" is not stored");
+    return _C_table.row (i, dag);
+}
 
-    // Cdag_i = \sum_k coef_ik Cdag_k
-    // Return the basis index (k), coefficient, and whether the operator has a dagger or not
-    // k to be returned is 1-index
-    auto tmp = _Uik(0,0);
-    vector<tuple<int,decltype(tmp),bool>> k_coef_dag;
+OneParticleBasis OneParticleBasis :: sub_basis (const vector<int>& ks) const
+{
+    Vector ens (ks.size());
+    Matrix U (nrows(_Uik), ks.size());
+    for(int j = 0; j < ks.size(); j++)
+    {
+        int k = ks.at(j);
+        mycheck (k > 0 and k <= size(), "out of range");
+        ens(j) = _ens(k-1);
+        column (U,j) &= column (_Uik,k-1);
+    }
+    auto sub = OneParticleBasis (_name, ens, U, _rows, (size() > 0 ? mu(1) : 0.));
+    if (nrows(_Hk) > 0)
+    {
+        sub._Hk = Matrix (ks.size(), ks.size());
+        for(int j1 = 0; j1 < ks.size(); j1++)
+            for(int j2 = 0; j2 < ks.size(); j2++)
+                sub._Hk(j1,j2) = _Hk(ks.at(j1)-1,ks.at(j2)-1);
+    }
+    return sub;
+}
 
-    for(int k = 0; k < this->size(); k++)       // Here k is zero-index
+void OneParticleBasis :: rotate (const Matrix& W)
+{
+    int M = size();
+    mycheck (nrows(W) == M and ncols(W) == M, "size not match");
+    if (nrows(_Hk) == 0)
     {
-        k_coef_dag.emplace_back (k+1, iut::conj(_Uik(i-1,k)), dag);
+        _Hk = Matrix (M,M);
+        for(int k = 0; k < M; k++)
+            _Hk(k,k) = _ens(k);
+    }
+    _Hk = transpose(W) * _Hk * W;
+    _Uik = _Uik * W;
+    for(int k = 0; k < M; k++)
+        _ens(k) = _Hk(k,k);
+    make_C_table ();
+}
+
+void OneParticleBasis :: set_mode_hamilt (const Matrix& Hk)
+{
+    mycheck (nrows(Hk) == size() and ncols(Hk) == size(), "size not match");
+    _Hk = Hk;
+    for(int k = 0; k < size(); k++)
+        _ens(k) = _Hk(k,k);
+}
+
+vector<tuple<int,int,Real>> OneParticleBasis :: offdiag_terms (Real cutoff) const
+{
+    vector<tuple<int,int,Real>> terms;
+    for(int k1 = 0; k1 < nrows(_Hk); k1++)
+        for(int k2 = 0; k2 < ncols(_Hk); k2++)
+            if (k1 != k2 and abs(_Hk(k1,k2)) > cutoff)
+                terms.emplace_back (k1+1, k2+1, _Hk(k1,k2));
+    return terms;
+}
+
+void OneParticleBasis :: set_diag (const Matrix& H)
+{
+    int L = nrows(H);
+    _Hdiag = Vector (L);
+    for(int i = 0; i < L; i++)
+        _Hdiag(i) = H(i,i);
+}
+
+void OneParticleBasis :: keep_all_sites ()
+{
+    _rows.clear();
+    for(int i = 0; i < nrows(_Uik); i++)
+        _rows.push_back (i);
+}
+
+// Get the operator information in this basis for the operator Cdag_i, where i is the real-space site index.
+// Cdag_i = \sum_k coef_ik Cdag_k
+// Store the basis index (k), coefficient, and whether the operator has a dagger or not, for every stored i.
+// The rows of the sites which are not stored are empty.
+// Both i and k are 1-index
+void OneParticleBasis :: make_C_table ()
+{
+    int L = _rows.size();
+    vector<vector<tuple<int,Real,bool>>> rows (L);
+    for(int i = 0; i < L; i++)
+    {
+        int r = _rows.at(i);
+        if (r < 0) continue;
+        for(int k = 0; k < this->size(); k++)       // Here k is zero-index
+        {
+            rows.at(i).emplace_back (k+1, iut::conj(_Uik(r,k)), false);
+        }
     }
-    return k_coef_dag;
+    _C_table = COpTable<Real> (rows, false);
 }
 
 auto write (ostream& s, const OneParticleBasis& t)
@@ -0,0 +1,187 @@
+#ifndef __ORBORDER_H_CMC__
+#define __ORBORDER_H_CMC__
+#include <random>
+#include <numeric>
+#include "GaussianState.h"
+using namespace std;
+
+// Orbital orderings for the MPS from the mutual information I_ab of the Gaussian model.
+// An ordering is a permutation perm of the Gaussian indices: perm[p] is the orbital at position p.
+
+// Order by the Fiedler vector (second lowest eigenvector) of the graph Laplacian L = D - I
+vector<int> order_fiedler (const Matrix& I)
+{
+    int N = nrows(I);
+    Matrix L (N,N);
+    for(int a = 0; a < N; a++)
+    {
+        Real d = 0.;
+        for(int b = 0; b < N; b++)
+            if (b != a)
+            {
+                L(a,b) = -I(a,b);
+                d += I(a,b);
+            }
+        L(a,a) = d;
+    }
+    Matrix V;
+    Vector ev;
+    diagHermitian (L, V, ev);
+    // Find the second lowest eigenvalue; do not assume the order of diagHermitian
+    vector<int> js (N);
+    std::iota (js.begin(), js.end(), 0);
+    std::sort (js.begin(), js.end(), [&ev] (int i, int j) { return ev(i) < ev(j); });
+    int jf = (N > 1 ? js.at(1) : js.at(0));
+
+    vector<int> perm (N);
+    std::iota (perm.begin(), perm.end(), 0);
+    std::stable_sort (perm.begin(), perm.end(), [&V,jf] (int a, int b) { return V(a,jf) < V(b,jf); });
+    return perm;
+}
+
+// Cost of an ordering: sum_ab I_ab |p_a - p_b|^2
+Real order_cost (const Matrix& I, const vector<int>& perm)
+{
+    int N = perm.size();
+    Real cost = 0.;
+    for(int p = 0; p < N; p++)
+        for(int q = p+1; q < N; q++)
+            cost += I(perm[p],perm[q]) * (q-p)*(q-p);
+    return cost;
+}
+
+// Simulated annealing of order_cost with swaps of two positions, starting from <perm>
+vector<int> order_anneal (const Matrix& I, vector<int> perm, int nsteps=100000, Real T0=1., unsigned seed=1)
+{
+    int N = perm.size();
+    if (N < 2) return perm;
+    std::mt19937 gen (seed);
+    std::uniform_int_distribution<int> pos (0, N-1);
+    std::uniform_real_distribution<Real> uni (0., 1.);
+
+    // Change of the cost when the orbitals at positions p and q are swapped
+    auto delta = [&I, &perm, N] (int p, int q)
+    {
+        int a = perm[p], b = perm[q];
+        Real d = 0.;
+        for(int r = 0; r < N; r++)
+        {
+            if (r == p or r == q) continue;
+            int c = perm[r];
+            d += (I(a,c) - I(b,c)) * (Real((q-r)*(q-r)) - Real((p-r)*(p-r)));
+        }
+        return d;
+    };
+
+    Real cost = order_cost (I, perm);
+    auto best = perm;
+    Real best_cost = cost;
+    for(int s = 0; s < nsteps; s++)
+    {
+        Real T = T0 * (1. - Real(s)/nsteps) + 1e-12;
+        int p = pos (gen), q = pos (gen);
+        if (p == q) continue;
+        Real d = delta (p, q);
+        if (d < 0. or uni (gen) < exp (-d/T))
+        {
+            swap (perm[p], perm[q]);
+            cost += d;
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best = perm;
+            }
+        }
+    }
+    return best;
+}
+
+// Entanglement entropy of the Gaussian state at every cut of the ordering
+vector<Real> cut_entropies (const GaussianModel& g, const vector<int>& perm)
+{
+    vector<Real> Ss;
+    vector<int> left;
+    for(int p = 0; p+1 < perm.size(); p++)
+    {
+        left.push_back (perm[p]);
+        Ss.push_back (g.entropy (left));
+    }
+    return Ss;
+}
+
+// Bond dimension estimated from the largest cut entropy, m ~ exp(S)
+Real predicted_max_dim (const vector<Real>& Ss)
+{
+    Real Smax = 0.;
+    for(auto S : Ss) Smax = max (Smax, S);
+    return exp (Smax);
+}
+
+// Convert an ordering to SortInfo, with the charge site <orb_C> put at the middle of the scatterer orbitals.
+// The energies are taken from <info0>.
+vector<SortInfo> order_to_info (const GaussianModel& g, const vector<int>& perm, const vector<SortInfo>& info0, const string& sname)
+{
+    map<pair<string,int>,Real> ens;
+    SortInfo orb_C;
+    for(auto const& s : info0)
+    {
+        auto const& [name, k, en] = s;
+        ens[{name,k}] = en;
+        if (name == PartC::name)
+            orb_C = s;
+    }
+    vector<SortInfo> info;
+    vector<int> s_pos;
+    for(int a : perm)
+    {
+        auto const& [name, k] = g.orb(a);
+        if (name == sname)
+            s_pos.push_back (info.size());
+        info.emplace_back (name, k, ens.at({name,k}));
+    }
+    int ic = (s_pos.size() == 0 ? info.size()/2 : s_pos.at (s_pos.size()/2));
+    info.insert (info.begin()+ic, orb_C);
+    return info;
+}
+
+// Permutation of the Gaussian indices corresponding to <info> (charge site dropped)
+vector<int> info_to_order (const GaussianModel& g, const vector<SortInfo>& info)
+{
+    vector<int> perm;
+    for(auto const& [name, k, en] : info)
+        if (name != PartC::name)
+            perm.push_back (g.index (name, k));
+    return perm;
+}
+
+// Candidate orderings: "energy" (the input <info0>), "fiedler" and "anneal" (annealing started from fiedler).
+// The Gaussian model is evolved to time <t_probe> before the mutual information is measured.
+// Print the predicted maximal bond dimension of each ordering.
+template <typename BasisL, typename BasisR, typename BasisS, typename Para>
+vector<pair<string,vector<SortInfo>>>
+optimize_orbital_order (const vector<SortInfo>& info0, const BasisL& leadL, const BasisR& leadR, const BasisS& scatterer,
+                        Real muL, Real muR, const Para& para, Real t_probe, int anneal_steps)
+{
+    auto g = get_gaussian_Kitaev_chain (info0, leadL, leadR, scatterer, muL, muR, para);
+    g.evolve (t_probe);
+    auto I = g.mutual_information ();
+
+    vector<pair<string,vector<int>>> perms;
+    perms.emplace_back ("energy", info_to_order (g, info0));
+    perms.emplace_back ("fiedler", order_fiedler (I));
+    perms.emplace_back ("anneal", order_anneal (I, perms.back().second, anneal_steps));
+
+    vector<pair<string,vector<SortInfo>>> orders;
+    cout << "Orbital ordering: name, cost, predicted max dim" << endl;
+    for(auto const& [name, perm] : perms)
+    {
+        auto Ss = cut_entropies (g, perm);
+        cout << "\t" << name << " " << order_cost (I, perm) << " " << predicted_max_dim (Ss) << endl;
+        if (name == "energy")
+            orders.emplace_back (name, info0);
+        else
+            orders.emplace_back (name, order_to_info (g, perm, info0, scatterer.name()));
+    }
+    return orders;
+}
+#endif
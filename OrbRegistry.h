@@ -0,0 +1,138 @@
+#ifndef __ORBREGISTRY_H_CMC__
+#define __ORBREGISTRY_H_CMC__
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "ReadWriteFile.h"
+using namespace std;
+
+// Partition names (basis names) interned to small integer IDs.
+// The partitions used in this project have fixed IDs and compile-time tags; other names get IDs when add() registers them,
+// which only ToGlobDict::set does. id() only looks up, so that a misspelled name is an error instead of a new partition.
+// The lookups may run on the measurement threads, so the list is guarded by a mutex.
+struct PartL { static constexpr int id = 0; static constexpr const char* name = "L"; };
+struct PartR { static constexpr int id = 1; static constexpr const char* name = "R"; };
+struct PartS { static constexpr int id = 2; static constexpr const char* name = "S"; };
+struct PartC { static constexpr int id = 3; static constexpr const char* name = "C"; };
+
+class PartitionNames
+{
+    public:
+        static int id (const string& name)
+        {
+            std::lock_guard<std::mutex> lock (mutex());
+            int i = find (name);
+            mycheck (i != -1, "Unknown partition: "+name);
+            return i;
+        }
+        // Register <name> if it is new, and return its ID
+        static int add (const string& name)
+        {
+            std::lock_guard<std::mutex> lock (mutex());
+            int i = find (name);
+            if (i != -1)
+                return i;
+            get().push_back (name);
+            return get().size()-1;
+        }
+        static string name (int id)
+        {
+            std::lock_guard<std::mutex> lock (mutex());
+            return get().at(id);
+        }
+
+    private:
+        static vector<string>& get ()
+        {
+            static vector<string> names = {PartL::name, PartR::name, PartS::name, PartC::name};
+            return names;
+        }
+        static std::mutex& mutex ()
+        {
+            static std::mutex m;
+            return m;
+        }
+        static int find (const string& name)
+        {
+            auto const& names = get();
+            for(int i = 0; i < names.size(); i++)
+                if (names[i] == name)
+                    return i;
+            return -1;
+        }
+};
+
+// {partition, ki} -> orbital index
+//
+// The lookup table is a dense vector per partition, so that at(pid,k) is two vector accesses.
+// The string interface at({name,k}) is kept for the code outside inner loops;
+// inner loops should take part_id(name) once and use at(pid,k).
+class ToGlobDict
+{
+    public:
+        using Key = pair<string,int>;
+
+        ToGlobDict () {}
+        ToGlobDict (const map<Key,int>& m) { for(auto const& [key, i] : m) set (key, i); }
+
+        void set (const Key& key, int i)
+        {
+            auto const& [name, k] = key;
+            int pid = PartitionNames::add (name);
+            if (_table.size() <= pid)
+                _table.resize (pid+1);
+            auto& row = _table.at(pid);
+            if (row.size() <= k)
+                row.resize (k+1, -1);
+            if (row.at(k) == -1)
+                _size++;
+            row.at(k) = i;
+        }
+
+        int at (int pid, int k) const
+        {
+            int i = (pid < _table.size() and k < _table[pid].size() ? _table[pid][k] : -1);
+            mycheck (i != -1, "orbital not found");
+            return i;
+        }
+        template <typename Tag>
+        int at (Tag, int k)            const { return at (Tag::id, k); }
+        int at (const Key& key)        const { return at (PartitionNames::id (key.first), key.second); }
+
+        static int part_id (const string& name) { return PartitionNames::id (name); }
+
+        int  size () const { return _size; }
+
+        // The same content as the map used before, for serialization and comparisons
+        map<Key,int> to_map () const
+        {
+            map<Key,int> m;
+            for(int pid = 0; pid < _table.size(); pid++)
+                for(int k = 0; k < _table[pid].size(); k++)
+                    if (_table[pid][k] != -1)
+                        m[{PartitionNames::name(pid), k}] = _table[pid][k];
+            return m;
+        }
+        bool operator== (const ToGlobDict& other) const { return to_map() == other.to_map(); }
+
+    private:
+        vector<vector<int>> _table;   // _table[pid][k]; -1 if not present
+        int                 _size = 0;
+};
+
+// Keep the file format of the map<pair<string,int>,int> checkpoints
+namespace iut
+{
+inline void write (ostream& s, const ToGlobDict& d)
+{
+    iut::write (s, d.to_map());
+}
+inline void read (istream& s, ToGlobDict& d)
+{
+    map<ToGlobDict::Key,int> m;
+    iut::read (s, m);
+    d = ToGlobDict (m);
+}
+}
+#endif
@@ -0,0 +1,543 @@
+#ifndef __PARAMMPO_H_CMC__
+#define __PARAMMPO_H_CMC__
+#include "itensor/all.h"
+#include "ContainerUtility.h"
+using namespace itensor;
+using namespace std;
+
+// H = sum_g c_g (H_g + id_g), where H_g is the MPO of the terms multiplied by the scalar parameter c_g,
+// and id_g is a constant (a multiple of the identity). H_g can be an empty MPO for a purely constant group.
+//
+// The groups are merged into one MPO in the finite-state-machine form, with the identity channels shared:
+// every link has one "start" state (identity on the left) and one "done" state (identity on the right) for all the groups,
+// plus the other states of each group. The link dimension is therefore that of the direct sum minus two per extra group,
+// which is what a single toMPO of all the terms gives when the groups do not share operator strings.
+//
+// A group enters the MPO only through its transitions out of the start state; these elements are the ones scaled by c_g.
+// They are kept, unscaled, for each site where the group has them, and changing c_g rewrites those site tensors in place.
+// The constants id_g are start-to-done transitions on site 1.
+//
+// The start and done states of H_g are read off the MPO tensors,
+//      W_b s_b = s_(b-1) Id    and    d_(b-1) W_b = Id d_b,
+// solved bond by bond from the boundaries; the other states are completed orthogonally within the QN blocks.
+// The constant part of a group must be passed in id_g, since a term that is the identity everywhere mixes the two channels.
+class ParamMPO
+{
+    public:
+        ParamMPO () {}
+        ParamMPO (const vector<string>& names, const vector<MPO>& Hs, const vector<Real>& coefs, const vector<Real>& ids);
+
+        // Update the coefficient of group <name>; return true if the MPO changed
+        bool set_coef (const string& name, Real c);
+        Real coef     (const string& name) const { return _coefs.at (group (name)); }
+        bool has      (const string& name) const { return iut::in_vector (_names, name); }
+
+        const MPO& mpo () const { return _H; }
+
+        // The last site changed by set_coef since clear_changed; 0 if none
+        int  max_changed   () const { return _max_changed; }
+        void clear_changed ()       { _max_changed = 0; }
+
+    private:
+        int  group       (const string& name) const;
+        void update_site (int b);
+
+        vector<string>  _names;
+        vector<Real>    _coefs;
+        // The coefficient-free part of each site tensor (shared identities and the inner transitions of all groups),
+        // and the unscaled transitions out of the start state of each group on the sites where it has them
+        vector<ITensor>          _Fs;
+        vector<map<int,ITensor>> _Ps;
+        MPO             _H;
+        int             _max_changed = 0;
+};
+
+// The elements of an MPO tensor as the matrices M[(a-1)*d+(b-1)](k,l) = W(l1=k, l2=l, s'=a, s=b);
+// l1 or l2 is an empty Index at the ends of the MPO
+inline vector<Matrix> mpo_site_matrices (const ITensor& W, const Index& l1, const Index& l2, const Index& s)
+{
+    int d  = dim (s),
+        D1 = (l1 ? dim (l1) : 1),
+        D2 = (l2 ? dim (l2) : 1);
+    vector<Matrix> Ms (d*d, Matrix (D1,D2));
+    for(int k = 1; k <= D1; k++)
+        for(int l = 1; l <= D2; l++)
+            for(int a = 1; a <= d; a++)
+                for(int b = 1; b <= d; b++)
+                {
+                    Cplx z;
+                    if (!l1)      z = eltC (W, l2=l, prime(s)=a, s=b);
+                    else if (!l2) z = eltC (W, l1=k, prime(s)=a, s=b);
+                    else          z = eltC (W, l1=k, l2=l, prime(s)=a, s=b);
+                    mycheck (abs (z.imag()) < 1e-12, "ParamMPO needs real MPOs");
+                    Ms.at((a-1)*d+b-1)(k-1,l-1) = z.real();
+                }
+    return Ms;
+}
+
+// Least-squares solution of G x = r, where G = A^T A and r = A^T y are the normal equations, with the pseudo-inverse of G.
+// Return the residual |A x - y|^2 / |y|^2, given yy = |y|^2.
+inline Real solve_normal (const Matrix& G, const Vector& r, Real yy, Vector& x)
+{
+    Matrix V;
+    Vector e;
+    diagHermitian (G, V, e);
+    int n = r.size();
+    Real emax = 0.;
+    for(int j = 0; j < n; j++)
+        emax = max (emax, abs (e(j)));
+    x = Vector (n);
+    for(int j = 0; j < n; j++)
+    {
+        if (abs (e(j)) <= 1e-12 * emax) continue;
+        Real c = 0.;
+        for(int i = 0; i < n; i++)
+            c += V(i,j) * r(i);
+        c /= e(j);
+        for(int i = 0; i < n; i++)
+            x(i) += c * V(i,j);
+    }
+    // |A x - y|^2 = x G x - 2 x r + yy
+    Real res = yy;
+    for(int i = 0; i < n; i++)
+    {
+        Real Gx = 0.;
+        for(int j = 0; j < n; j++)
+            Gx += G(i,j) * x(j);
+        res += x(i) * Gx - 2. * x(i) * r(i);
+    }
+    return res / yy;
+}
+
+// Start state s_b from s_(b-1): W_b s_b = s_(b-1) Id; return false if there is none
+inline bool next_start_state (const vector<Matrix>& Ms, int d, const Vector& s_prev, Vector& s)
+{
+    int D2 = ncols (Ms.front());
+    Matrix G (D2,D2);
+    Vector r (D2);
+    for(int a = 0; a < d; a++)
+        for(int b = 0; b < d; b++)
+        {
+            auto const& M = Ms.at(a*d+b);
+            G += transpose(M) * M;
+            if (a == b)
+                r += transpose(M) * s_prev;
+        }
+    Real res = solve_normal (G, r, d * (s_prev*s_prev), s);
+    return res < 1e-10;
+}
+
+// Done state d_(b-1) from d_b: d_(b-1) W_b = Id d_b; return false if there is none
+inline bool prev_done_state (const vector<Matrix>& Ms, int d, const Vector& d_next, Vector& dd)
+{
+    int D1 = nrows (Ms.front());
+    Matrix G (D1,D1);
+    Vector r (D1);
+    for(int a = 0; a < d; a++)
+        for(int b = 0; b < d; b++)
+        {
+            auto const& M = Ms.at(a*d+b);
+            G += M * transpose(M);
+            if (a == b)
+                r += M * d_next;
+        }
+    Real res = solve_normal (G, r, d * (d_next*d_next), dd);
+    return res < 1e-10;
+}
+
+// The change of basis of a link of a group: the rows of R are the new states in the old basis,
+// the start state s/|s|^2 first, then the done state d, then an orthonormal completion within each QN sector.
+// kinds[i] is 0, 1, 2 for the start, done, and other states; qns[i] is the QN of the state i.
+// The rows are orthogonal, so the inverse is R^T diag(1/|row|^2).
+inline void link_basis (const Index& l, const Vector& s, const Vector& dd, Matrix& R, vector<int>& kinds, vector<QN>& qns)
+{
+    int D = dim (l);
+    // The states grouped by QN sectors
+    vector<QN> sec_qns;
+    vector<vector<int>> sec_pos;
+    if (hasQNs (l))
+    {
+        int i0 = 0;
+        for(int bl = 1; bl <= nblock (l); bl++)
+        {
+            auto q = qn (l, bl);
+            int  n = blocksize (l, bl);
+            int sec = -1;
+            for(int i = 0; i < sec_qns.size(); i++)
+                if (sec_qns.at(i) == q)
+                    sec = i;
+            if (sec == -1)
+            {
+                sec = sec_qns.size();
+                sec_qns.push_back (q);
+                sec_pos.emplace_back ();
+            }
+            for(int i = i0; i < i0+n; i++)
+                sec_pos.at(sec).push_back (i);
+            i0 += n;
+        }
+    }
+    else
+    {
+        sec_qns.push_back (QN());
+        sec_pos.emplace_back ();
+        for(int i = 0; i < D; i++)
+            sec_pos.back().push_back (i);
+    }
+
+    // The sector of a special state, which must be in a single one
+    auto sector_of = [&] (const Vector& v)
+    {
+        if (v.size() == 0) return -1;
+        int found = -1;
+        for(int sec = 0; sec < sec_pos.size(); sec++)
+            for(int i : sec_pos.at(sec))
+                if (abs (v(i)) > 1e-12 * norm (v))
+                {
+                    mycheck (found == -1 or found == sec, "identity channel is not in a single QN sector");
+                    found = sec;
+                }
+        return found;
+    };
+    int sec_s = sector_of (s),
+        sec_d = sector_of (dd);
+
+    R = Matrix (D,D);
+    kinds.clear();
+    qns.clear();
+    int row = 0;
+    if (sec_s != -1)
+    {
+        for(int i = 0; i < D; i++)
+            R(row,i) = s(i) / (s*s);
+        kinds.push_back (0);
+        qns.push_back (sec_qns.at(sec_s));
+        row++;
+    }
+    if (sec_d != -1)
+    {
+        for(int i = 0; i < D; i++)
+            R(row,i) = dd(i);
+        kinds.push_back (1);
+        qns.push_back (sec_qns.at(sec_d));
+        row++;
+    }
+    for(int sec = 0; sec < sec_pos.size(); sec++)
+    {
+        auto const& pos = sec_pos.at(sec);
+        int m = pos.size();
+        // Projector onto the complement of the special states in this sector
+        Matrix Proj (m,m);
+        for(int i = 0; i < m; i++)
+            Proj(i,i) = 1.;
+        vector<Vector> es;
+        for(auto [v, sec_v] : {make_pair(s,sec_s), make_pair(dd,sec_d)})
+        {
+            if (sec_v != sec) continue;
+            Vector e (m);
+            for(int i = 0; i < m; i++)
+                e(i) = v(pos.at(i));
+            for(auto const& e0 : es)
+                e -= (e0*e) * e0;
+            e /= norm (e);
+            es.push_back (e);
+            for(int i = 0; i < m; i++)
+                for(int j = 0; j < m; j++)
+                    Proj(i,j) -= e(i) * e(j);
+        }
+        Matrix V;
+        Vector ev;
+        diagHermitian (Proj, V, ev);
+        for(int j = 0; j < m; j++)
+        {
+            if (ev(j) < 0.5) continue;
+            for(int i = 0; i < m; i++)
+                R(row,pos.at(i)) = V(i,j);
+            kinds.push_back (2);
+            qns.push_back (sec_qns.at(sec));
+            row++;
+        }
+    }
+    mycheck (row == D, "link basis not complete");
+}
+
+ParamMPO :: ParamMPO (const vector<string>& names, const vector<MPO>& Hs, const vector<Real>& coefs, const vector<Real>& ids)
+: _names (names)
+, _coefs (coefs)
+{
+    int G = Hs.size();
+    mycheck (names.size() == G and coefs.size() == G and ids.size() == G, "size not match");
+    int N = 0;
+    vector<Index> sites;
+    for(auto const& H : Hs)
+        if (length(H) != 0)
+        {
+            mycheck (N == 0 or length(H) == N, "MPO lengths not match");
+            N = length (H);
+            sites.resize (N+1);
+            for(int b = 1; b <= N; b++)
+                sites.at(b) = dag (findIndex (H(b), "Site,0"));
+        }
+    mycheck (N >= 2, "no MPO");
+
+    // Change of basis of each link of each group; the bonds 0 and N are the boundaries,
+    // with the start state on the left and the done state on the right
+    vector<vector<Matrix>> Rs (G, vector<Matrix> (N+1)), Bs (G, vector<Matrix> (N+1));
+    // The site tensors of each group in the new bases
+    vector<vector<vector<Matrix>>> Ts (G);
+    vector<vector<vector<int>>> kinds (G, vector<vector<int>> (N+1));
+    vector<vector<vector<QN>>> qns (G, vector<vector<QN>> (N+1));
+    for(int g = 0; g < G; g++)
+    {
+        auto const& H = Hs.at(g);
+        if (length(H) == 0) continue;
+        vector<vector<Matrix>> Ms (N+1);
+        for(int b = 1; b <= N; b++)
+        {
+            Index l1 = (b > 1 ? linkIndex (H,b-1) : Index()),
+                  l2 = (b < N ? linkIndex (H,b) : Index());
+            Ms.at(b) = mpo_site_matrices (H(b), l1, l2, sites.at(b));
+        }
+        int d = 0;
+
+        // Start states from the left, done states from the right
+        vector<Vector> ss (N+1), ds (N+1);
+        ss.at(0) = Vector (1);  ss.at(0)(0) = 1.;
+        ds.at(N) = Vector (1);  ds.at(N)(0) = 1.;
+        for(int b = 1; b < N; b++)
+        {
+            d = dim (sites.at(b));
+            Vector s;
+            if (ss.at(b-1).size() == 0 or !next_start_state (Ms.at(b), d, ss.at(b-1), s))
+                break;
+            ss.at(b) = s;
+        }
+        for(int b = N; b > 1; b--)
+        {
+            d = dim (sites.at(b));
+            Vector dd;
+            if (ds.at(b).size() == 0 or !prev_done_state (Ms.at(b), d, ds.at(b), dd))
+                break;
+            ds.at(b-1) = dd;
+        }
+
+        for(int b = 0; b <= N; b++)
+        {
+            auto const& s  = ss.at(b);
+            auto const& dd = ds.at(b);
+            if (s.size() != 0 and dd.size() != 0)
+                mycheck (abs (s*dd) < 1e-10 * norm(s) * norm(dd),
+                         "MPO group "+names.at(g)+": start and done states are not separable; pass its constant part in ids");
+            auto& R = Rs.at(g).at(b);
+            if (b == 0 or b == N)
+            {
+                R = Matrix (1,1);
+                R(0,0) = 1.;
+                kinds.at(g).at(b) = {(b == 0 ? 0 : 1)};
+            }
+            else
+                link_basis (linkIndex (H,b), s, dd, R, kinds.at(g).at(b), qns.at(g).at(b));
+            auto& B = Bs.at(g).at(b);
+            B = transpose (R);
+            for(int j = 0; j < ncols(B); j++)
+            {
+                Real rr = 0.;
+                for(int i = 0; i < nrows(B); i++)
+                    rr += R(j,i) * R(j,i);
+                for(int i = 0; i < nrows(B); i++)
+                    B(i,j) /= rr;
+            }
+        }
+
+        for(int b = 1; b <= N; b++)
+            for(auto& M : Ms.at(b))
+                M = Rs.at(g).at(b-1) * M * Bs.at(g).at(b);
+        Ts.at(g) = std::move (Ms);
+    }
+
+    // The merged links: the shared start (1) and done (2) states, then the other states of each group.
+    // pos[g][b][i] is the position of the state i of group g on the merged link b.
+    vector<vector<vector<int>>> pos (G, vector<vector<int>> (N+1));
+    vector<Index> links (N+1);
+    for(int b = 1; b < N; b++)
+    {
+        // The shared states have the QN of the identity channels of the groups
+        QN q0;
+        bool has_q0 = false;
+        for(int g = 0; g < G; g++)
+            for(int i = 0; i < kinds.at(g).at(b).size(); i++)
+                if (kinds.at(g).at(b).at(i) != 2)
+                {
+                    auto q = qns.at(g).at(b).at(i);
+                    mycheck (!has_q0 or q == q0, "identity channels with different QNs");
+                    q0 = q;
+                    has_q0 = true;
+                }
+
+        vector<QN> link_qns = {q0, q0};
+        for(int g = 0; g < G; g++)
+        {
+            auto const& ks = kinds.at(g).at(b);
+            pos.at(g).at(b).resize (ks.size());
+            for(int i = 0; i < ks.size(); i++)
+            {
+                if (ks.at(i) == 2)
+                {
+                    link_qns.push_back (qns.at(g).at(b).at(i));
+                    pos.at(g).at(b).at(i) = link_qns.size();
+                }
+                else
+                    pos.at(g).at(b).at(i) = ks.at(i) + 1;
+            }
+        }
+
+        auto tags = TagSet ("Link,l="+str(b));
+        if (has_q0 and hasQNs (sites.at(b)))
+        {
+            // Neighbouring states with the same QN form a block
+            int nb = 0;
+            for(int i = 0; i < link_qns.size(); i++)
+                if (i == 0 or !(link_qns.at(i) == link_qns.at(i-1)))
+                    nb++;
+            auto qnstore = Index::qnstorage (nb);
+            int bl = -1;
+            for(int i = 0; i < link_qns.size(); i++)
+            {
+                if (i == 0 or !(link_qns.at(i) == link_qns.at(i-1)))
+                    qnstore.at(++bl) = QNInt (link_qns.at(i), 0);
+                qnstore.at(bl).second++;
+            }
+            links.at(b) = Index (std::move(qnstore), Out, tags);
+        }
+        else
+            links.at(b) = Index (link_qns.size(), tags);
+    }
+    for(int g = 0; g < G; g++)
+    {
+        pos.at(g).at(0) = {1};
+        pos.at(g).at(N) = {2};
+    }
+
+    // Site tensors
+    _H = MPO (N);
+    _Fs.resize (N+1);
+    _Ps.resize (G);
+    for(int b = 1; b <= N; b++)
+    {
+        auto s = sites.at(b);
+        int d = dim (s);
+        vector<Index> inds;
+        if (b > 1) inds.push_back (dag (links.at(b-1)));
+        if (b < N) inds.push_back (links.at(b));
+        inds.push_back (prime(s));
+        inds.push_back (dag(s));
+        auto empty_tensor = [&] () { return ITensor (IndexSet (inds)); };
+        auto set_elt = [&] (ITensor& T, int k, int l, int a, int bb, Real v)
+        {
+            if (b == 1)      T.set (links.at(b)=l, prime(s)=a, s=bb, v);
+            else if (b == N) T.set (links.at(b-1)=k, prime(s)=a, s=bb, v);
+            else             T.set (links.at(b-1)=k, links.at(b)=l, prime(s)=a, s=bb, v);
+        };
+
+        // The shared identities: start to start before the last site, done to done after the first one
+        auto& F = _Fs.at(b);
+        F = empty_tensor ();
+        for(int a = 1; a <= d; a++)
+        {
+            if (b < N) set_elt (F, 1, 1, a, a, 1.);
+            if (b > 1) set_elt (F, 2, 2, a, a, 1.);
+        }
+
+        for(int g = 0; g < G; g++)
+        {
+            ITensor P = empty_tensor ();
+            bool has_P = false;
+            if (b == 1 and ids.at(g) != 0.)
+            {
+                for(int a = 1; a <= d; a++)
+                    set_elt (P, 1, 2, a, a, ids.at(g));
+                has_P = true;
+            }
+            if (length(Hs.at(g)) != 0)
+            {
+                auto const& Ms = Ts.at(g).at(b);
+                auto const& k1 = kinds.at(g).at(b-1),
+                          & k2 = kinds.at(g).at(b);
+                Real scale = 0.;
+                for(auto const& M : Ms)
+                    scale = max (scale, norm (M));
+                for(int a = 1; a <= d; a++)
+                    for(int bb = 1; bb <= d; bb++)
+                    {
+                        auto const& M = Ms.at((a-1)*d+bb-1);
+                        for(int k = 0; k < nrows(M); k++)
+                            for(int l = 0; l < ncols(M); l++)
+                            {
+                                Real v = M(k,l);
+                                int kk = k1.at(k), kl = k2.at(l);
+                                // The identities are shared
+                                if ((kk == 0 and kl == 0) or (kk == 1 and kl == 1)) continue;
+                                if (abs(v) < 1e-14 * scale) continue;
+                                // Nothing leaves the done state or enters the start state
+                                mycheck (kk != 1 and kl != 0, "MPO group "+names.at(g)+" is not in the finite-state-machine form");
+                                int pk = pos.at(g).at(b-1).at(k),
+                                    pl = pos.at(g).at(b).at(l);
+                                if (kk == 0)
+                                {
+                                    set_elt (P, pk, pl, a, bb, v);
+                                    has_P = true;
+                                }
+                                else
+                                    set_elt (F, pk, pl, a, bb, v);
+                            }
+                    }
+            }
+            if (has_P)
+                _Ps.at(g)[b] = P;
+        }
+        update_site (b);
+    }
+}
+
+int ParamMPO :: group (const string& name) const
+{
+    for(int g = 0; g < _names.size(); g++)
+        if (_names.at(g) == name)
+            return g;
+    throw ITError ("Unknown MPO group: "+name);
+}
+
+void ParamMPO :: update_site (int b)
+{
+    ITensor W = _Fs.at(b);
+    for(int g = 0; g < _Ps.size(); g++)
+        if (_Ps.at(g).count (b))
+            W += _coefs.at(g) * _Ps.at(g).at(b);
+    _H.ref(b) = W;
+}
+
+bool ParamMPO :: set_coef (const string& name, Real c)
+{
+    int g = group (name);
+    if (_coefs.at(g) == c)
+        return false;
+    _coefs.at(g) = c;
+    for(auto const& [b, P] : _Ps.at(g))
+    {
+        update_site (b);
+        _max_changed = max (_max_changed, b);
+    }
+    return true;
+}
+
+// Call after ParamMPO::set_coef changed the MPO that PH points to.
+// When only site 1 changed, the environments do not contain it if the orthogonality center is at site 1,
+// and they are kept; otherwise all environments are rebuilt.
+template <typename LocalOpT>
+void invalidate_changed_sites (LocalOpT& PH, const MPS& psi, ParamMPO& H)
+{
+    if (H.max_changed() > 1 or orthoCenter (psi) != 1)
+        PH.reset();
+    H.clear_changed();
+}
+#endif
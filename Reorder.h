@@ -0,0 +1,99 @@
+#ifndef __REORDER_H_CMC__
+#define __REORDER_H_CMC__
+#include "itensor/all.h"
+#include "SortBasis.h"
+using namespace itensor;
+using namespace std;
+
+// Reordering of the MPS sites during the time evolution.
+// Two neighboring sites are exchanged by a swap gate; the sign (-1)^(n1*n2) is included if both are fermions
+// (the charge site is bosonic and commutes with the fermions).
+
+bool is_fermion_site (const Index& s)
+{
+    return hasTags (s, "Fermion");
+}
+
+// Swap the sites b and b+1 of psi. The orthogonality center ends at b+1.
+// Return the spectrum of the SVD, which has the discarded weight.
+Spectrum swap_sites (MPS& psi, int b, const Args& args=Args::global())
+{
+    psi.position(b);
+    auto phi = psi(b) * psi(b+1);
+    auto s1 = findIndex (psi(b), "Site");
+    auto s2 = findIndex (psi(b+1), "Site");
+
+    // Fermionic sign: diag(1,1,1,-1) in the basis |n1,n2>
+    if (is_fermion_site(s1) and is_fermion_site(s2))
+    {
+        auto sign = ITensor (dag(s1), dag(s2), prime(s1), prime(s2));
+        for(int n1 = 1; n1 <= 2; n1++)
+            for(int n2 = 1; n2 <= 2; n2++)
+                sign.set (s1=n1, s2=n2, prime(s1)=n1, prime(s2)=n2, (n1 == 2 and n2 == 2 ? -1. : 1.));
+        phi *= sign;
+        phi.noPrime ("Site");
+    }
+
+    // Put s2 on the left
+    IndexSet uinds;
+    if (b > 1)
+        uinds = IndexSet (leftLinkIndex (psi,b), s2);
+    else
+        uinds = IndexSet (s2);
+    ITensor U (uinds), S, V;
+    auto spec = svd (phi, U, S, V, args);
+    psi.ref(b) = U;
+    psi.ref(b+1) = S*V;
+    psi.leftLim (b);
+    psi.rightLim (b+2);
+    return spec;
+}
+
+// Move the site <from> to position <to> by neighboring swaps, and update the orbital dictionaries
+void move_site (MPS& psi, int from, int to, ToGlobDict& to_glob, ToLocDict& to_loc, const Args& args=Args::global())
+{
+    while (from < to)
+    {
+        swap_sites (psi, from, args);
+        swap (to_loc.at(from), to_loc.at(from+1));
+        from++;
+    }
+    while (from > to)
+    {
+        swap_sites (psi, from-1, args);
+        swap (to_loc.at(from-1), to_loc.at(from));
+        from--;
+    }
+    to_glob = ToGlobDict ();
+    for(int i = 1; i < to_loc.size(); i++)
+        to_glob.set (to_loc.at(i), i);
+}
+
+// Decide where to move the charge site when the bonds next to it reach <frac> of the maximal dimension.
+// The new position is the one within <window> sites which has the lowest bond dimension to split.
+// Return the current position if no move is needed.
+int charge_site_target (const MPS& psi, int ic, int maxdim, Real frac=0.9, int window=4)
+{
+    int N = length(psi);
+    auto link_dim = [&psi, N] (int b) { return (b >= 1 and b < N ? dim (linkIndex (psi,b)) : 1); };
+    int m_here = max (link_dim (ic-1), link_dim (ic));
+    if (m_here < frac * maxdim)
+        return ic;
+
+    // Inserting the charge site at position p splits the current bond between p-1 and p (or p and p+1)
+    int target = ic;
+    int m_best = m_here;
+    for(int p = max(1,ic-window); p <= min(N,ic+window); p++)
+    {
+        if (p == ic) continue;
+        int b = (p < ic ? p-1 : p);
+        int m = link_dim (b);
+        if (m < m_best)
+        {
+            m_best = m;
+            target = p;
+        }
+    }
+    return target;
+}
+#endif
@@ -1,7 +1,8 @@
 #ifndef __SORTBASIS_H_CMC__
 #define __SORTBASIS_H_CMC__
+#include "OrbRegistry.h"
 
-using ToGlobDict = map <pair<string,int>, int>;       // {partition, ki} -> ortical index
+// ToGlobDict: {partition, ki} -> ortical index, defined in OrbRegistry.h
 using ToLocDict = vector<pair<string,int>>;         // ortical index -> {partition, ki}
 using SortInfo = tuple <string, int, Real>;        // basis name, orbital index, energ
 
@@ -19,7 +20,7 @@ tuple<ToGlobDict,ToLocDict> make_orb_dicts (const vector<SortInfo>& orbs)
     for(int i = 1; i <= orbs.size(); i++)
     {
         auto [name, ki, en] = orbs.at(i-1);
-        to_glob[{name,ki}] = i;
+        to_glob.set ({name,ki}, i);
         to_local.at(i) = make_pair (name, ki);
     }
     return {to_glob, to_local};
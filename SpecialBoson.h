@@ -1,22 +1,74 @@
 #ifndef __SPECIALBOSON_H_CMC__
 #define __SPECIALBOSON_H_CMC__
 #include "itensor/mps/siteset.h"
+#include <array>
+#include <map>
 
+// Charge site with the states n = -MaxOcc,...,MaxOcc.
+// Every charge state is its own QN block of dimension 1, also when only the parity is conserved,
+// so the shift operators A, Adag, A2, A2dag store only their nonzero 1x1 blocks and the diagonal ones N, NSqr, I only the diagonal.
+// The block-sparse contractions in the MPO application and the effective-Hamiltonian products are then
+// relabelings of the blocks for the shifts and scalings of the blocks for the diagonal operators, without dense matrices.
 class SpecialBosonSite
 {
+    public:
+
+    // The operators, built once for the site index; op(string) maps the names to them
+    enum OpName { OpN, OpNSqr, OpA, OpAdag, OpA2, OpA2dag, OpI, NumOps };
+
+    private:
+
     Index s;
 
     vector<int> _ns;
 
+    std::array<ITensor,NumOps> _ops;
+
+    static const std::map<std::string,OpName>& op_names ()
+    {
+        static const std::map<std::string,OpName> names =
+            {{"N",OpN}, {"n",OpN}, {"NSqr",OpNSqr}, {"nSqr",OpNSqr}, {"A",OpA}, {"C",OpA}, {"Adag",OpAdag}, {"Cdag",OpAdag},
+             {"A2",OpA2}, {"A2dag",OpA2dag}, {"I",OpI}};
+        return names;
+    }
+
+    void make_ops ()
+    {
+        auto sP = prime(s);
+        for(auto& Op : _ops)
+            Op = ITensor(dag(s),sP);
+
+        for(int i = 0; i < _ns.size(); i++)
+        {
+            int j = i+1;
+            int n = _ns.at(i);
+            _ops[OpN].set(s=j,sP=j,n);
+            _ops[OpNSqr].set(s=j,sP=j,n*n);
+            _ops[OpI].set(s=j,sP=j,1);
+        }
+        for(int i = 1; i < _ns.size(); i++)
+        {
+            _ops[OpA].set(s=1+i,sP=i,1);
+            _ops[OpAdag].set(s=i,sP=1+i,1);
+        }
+        for(int i = 3; i <= _ns.size(); i++)
+        {
+            _ops[OpA2].set(s=i,sP=i-2,1);
+            _ops[OpA2dag].set(s=i-2,sP=i,1);
+        }
+    }
+
     public:
 
     int n (int i) const { return _ns.at(i-1); }
 
+    // The charge states are MinCharge,...,MaxCharge (default -MaxOcc,...,MaxOcc)
     SpecialBosonSite(Index I, Args const& args = Args::global()) : s(I)
     {
-        auto maxOcc = args.getInt("MaxOcc");
-        for(int n = -maxOcc; n <= maxOcc; n++)
-            _ns.push_back (n);
+        int lo = (args.defined("MinCharge") ? args.getInt("MinCharge") : -args.getInt("MaxOcc"));
+        for(int i = 0; i < dim(I); i++)
+            _ns.push_back (lo+i);
+        make_ops();
     }
 
     SpecialBosonSite(Args const& args = Args::global())
@@ -31,7 +83,9 @@ class SpecialBosonSite
         }
 
         auto maxOcc = args.getInt("MaxOcc");
-        for(int n = -maxOcc; n <= maxOcc; n++)
+        int lo = args.getInt("MinCharge",-maxOcc),
+            hi = args.getInt("MaxCharge",maxOcc);
+        for(int n = lo; n <= hi; n++)
             _ns.push_back (n);
 
         auto qints = Index::qnstorage(_ns.size());
@@ -59,6 +113,7 @@ class SpecialBosonSite
             }
         }
         s = Index(std::move(qints),Out,tags);
+        make_ops();
     }
 
     Index
@@ -77,71 +132,29 @@ class SpecialBosonSite
         return IndexVal{};
     }
 
-	ITensor op (std::string const& opname, Args const& args) const
-    {
-        auto sP = prime(s);
-
-        auto Op = ITensor(dag(s),sP);
+    ITensor op (OpName o) const { return _ops[o]; }
 
-        if(opname == "N" || opname == "n")
-        {
-            for(int i = 0; i < _ns.size(); i++)
-            {
-                int j = i+1;
-                int n = _ns.at(i);
-                Op.set(s=j,sP=j,n);
-            }
-        }
-        else if(opname == "NSqr" || opname == "nSqr")
-        {
-            for(int i = 0; i < _ns.size(); i++)
-            {
-                int j = i+1;
-                int n = _ns.at(i);
-                Op.set(s=j,sP=j,n*n);
-            }
-        }
-        else if(opname == "A" or opname == "C")
-        {
-            for(int i = 1; i < _ns.size(); i++)
-            {
-                Op.set(s=1+i,sP=i,1);
-            }
-        }
-        else if(opname == "Adag" or opname == "Cdag")
-        {
-            for(int i = 1; i < _ns.size(); i++)
-            {
-                Op.set(s=i,sP=1+i,1);
-            }
-        }
-        else if(opname == "A2")
-        {
-            for(int i = 3; i <= _ns.size(); i++)
-            {
-                Op.set(s=i,sP=i-2,1);
-            }
-        }
-        else if(opname == "A2dag")
-        {
-            for(int i = 3; i <= _ns.size(); i++)
-            {
-                Op.set(s=i-2,sP=i,1);
-            }
-        }
-        else if(opname == "I")
-        {
-            for(int i = 1; i <= _ns.size(); i++)
-            {
-                Op.set(s=i,sP=i,1);
-            }
-        }
-        else
-        {
+    // ITensor copies share the storage, so returning a copy of the table entry is cheap
+    ITensor op (std::string const& opname, Args const& args) const
+    {
+        auto it = op_names().find(opname);
+        if(it == op_names().end())
             throw ITError("Operator \"" + opname + "\" name not recognized");
-        }
-
-        return Op;
+        return _ops[it->second];
     }
 };
+
+// Weights |<n|A>|^2 of the charge states (1-index by the states of s) in the site tensor A at the orthogonality center.
+// Each slice touches only the blocks of one charge state, so this is one pass over A
+// instead of the contraction with N or the reduced density matrix.
+inline vector<Real> charge_weights (const ITensor& A, const Index& s)
+{
+    vector<Real> ps (dim(s), 0.);
+    for(int i = 1; i <= dim(s); i++)
+    {
+        Real w = norm (A * setElt(dag(s)=i));
+        ps.at(i-1) = w*w;
+    }
+    return ps;
+}
 #endif
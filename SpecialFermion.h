@@ -2,14 +2,58 @@
 #define __SPECIALFERMION_H_CMC__
 #include "itensor/mps/siteset.h"
 #include "itensor/util/str.h"
+#include <array>
+#include <map>
 using namespace itensor;
 
 class SpecialFermionSite
 {
+    public:
+
+    // The operators, built once for the site index; op(string) maps the names to them
+    enum OpName { OpN, OpC, OpCdag, OpA, OpAdag, OpF, OpProjEmp, OpProjOcc, OpI, NumOps };
+
+    private:
+
     Index s;
+    std::array<ITensor,NumOps> _ops;
+
+    static const std::map<std::string,OpName>& op_names ()
+    {
+        static const std::map<std::string,OpName> names =
+            {{"N",OpN}, {"n",OpN}, {"C",OpC}, {"Cdag",OpCdag}, {"A",OpA}, {"Adag",OpAdag},
+             {"F",OpF}, {"FermiPhase",OpF}, {"projEmp",OpProjEmp}, {"projOcc",OpProjOcc}, {"I",OpI}};
+        return names;
+    }
+
+    void make_ops ()
+    {
+        auto sP = prime(s);
+
+        auto Emp  = s(1);
+        auto EmpP = sP(1);
+        auto Occ  = s(2);
+        auto OccP = sP(2);
+
+        for(auto& Op : _ops)
+            Op = ITensor(dag(s),sP);
+
+        _ops[OpN].set(Occ,OccP,1);
+        _ops[OpC].set(Occ,EmpP,1);
+        _ops[OpCdag].set(Emp,OccP,1);
+        _ops[OpA].set(Occ,EmpP,1);
+        _ops[OpAdag].set(Emp,OccP,1);
+        _ops[OpF].set(Emp,EmpP,1);
+        _ops[OpF].set(Occ,OccP,-1);
+        _ops[OpProjEmp].set(Emp,EmpP,1);
+        _ops[OpProjOcc].set(Occ,OccP,1);
+        _ops[OpI].set(Occ,OccP,1);
+        _ops[OpI].set(Emp,EmpP,1);
+    }
+
     public:
 
-    SpecialFermionSite(Index I) : s(I) { }
+    SpecialFermionSite(Index I) : s(I) { make_ops(); }
 
     SpecialFermionSite(Args const& args = Args::global())
     {
@@ -72,6 +116,7 @@ class SpecialFermionSite
             cout << "Unknown system type: " << systype << endl;
             throw;
         }
+        make_ops();
     }
 
     Index
@@ -96,72 +141,18 @@ class SpecialFermionSite
         return IndexVal{};
         }
 
-	ITensor
-	op(std::string const& opname,
-	   Args const& args) const
-        {
-        auto sP = prime(s);
+    ITensor
+    op(OpName o) const { return _ops[o]; }
 
-        auto Emp  = s(1);
-        auto EmpP = sP(1);
-        auto Occ  = s(2);
-        auto OccP = sP(2);
-         
-        auto Op = ITensor(dag(s),sP);
-
-        if(opname == "N" || opname == "n")
-            {
-            Op.set(Occ,OccP,1);
-            }
-        else
-        if(opname == "C")
-            {
-            Op.set(Occ,EmpP,1);
-            }
-        else
-        if(opname == "Cdag")
-            {
-            Op.set(Emp,OccP,1);
-            }
-        else
-        if(opname == "A")
-            {
-            Op.set(Occ,EmpP,1);
-            }
-        else
-        if(opname == "Adag")
-            {
-            Op.set(Emp,OccP,1);
-            }
-        else
-        if(opname == "F" || opname == "FermiPhase")
-            {
-            Op.set(Emp,EmpP,1);
-            Op.set(Occ,OccP,-1);
-            }
-        else
-        if(opname == "projEmp")
-            {
-            Op.set(Emp,EmpP,1);
-            }
-        else
-        if(opname == "projOcc")
-            {
-            Op.set(Occ,OccP,1); 
-            }
-        else
-        if(opname == "I")
-            {
-            Op.set(Occ,OccP,1);
-            Op.set(Emp,EmpP,1);
-            }
-        else
-            {
+    // ITensor copies share the storage, so returning a copy of the table entry is cheap
+    ITensor
+    op(std::string const& opname, Args const& args) const
+    {
+        auto it = op_names().find(opname);
+        if(it == op_names().end())
             throw ITError("Operator \"" + opname + "\" name not recognized");
-            }
-
-        return Op;
-        }
+        return _ops[it->second];
+    }
 };
 
 using SpecialFermion = BasicSiteSet<SpecialFermionSite>;
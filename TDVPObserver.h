@@ -5,6 +5,7 @@
 #include "itensor/all.h"
 #include "Entanglement.h"
 #include "ContainerUtility.h"
+#include "SpecialBoson.h"
 using namespace iut;
 using namespace iutility;
 
@@ -18,20 +19,43 @@ class TDVPObserver : public DMRGObserver
         , _ns (length(psi),0.)
         , _Npar (0.)
         , _specs (length(psi))
+        , _Ss (length(psi),0.)
+        , _Ss_site (length(psi),0.)
         {
             _write = args.getBool ("Write",false);
             _out_dir = args.getString("out_dir",".");
             _charge_site = args.getInt("charge_site",-1);
+            _print = args.getBool ("Print",true);
         }
 
         void measure (const Args& args);
 
+        // After the sites of the MPS have been reordered
+        void reset_sites (const SitesType& sites, int charge_site)
+        {
+            _sites = sites;
+            _charge_site = charge_site;
+            _ps.clear();
+        }
+
              Real   Npar () const { return _Npar; }
         auto const& ns   () const { return _ns; }
         const Spectrum& spec (int i) const { return _specs.at(i); }
+        // Entanglement entropy of bond i (1-index) from the last visit
+        auto const& entropies () const { return _Ss; }
+        // Entanglement entropy printed as *entS for site i (0-index)
+        auto const& site_entropies () const { return _Ss_site; }
+        // Weights of the states of the charge site from the last visit
+        auto const& charge_dist () const { return _ps; }
+
+        // MPOs whose expectation values are measured during the right-to-left half sweep:
+        // their right environments are extended by the sites that the sweep has finished,
+        // so the values are ready at the end of the sweep without a second pass over the MPS
+        void add_mpo (const string& name, const MPO& mpo) { _mpos[name] = mpo; }
+        Cplx expect  (const string& name) const { return _mpo_vals.at(name); }
 
     private:
-        bool        _write;
+        bool        _write, _print=true;
         string      _out_dir;	// empty string "" if not write
         SitesType   _sites;
         int         _charge_site=-1;
@@ -40,6 +64,16 @@ class TDVPObserver : public DMRGObserver
         vector<Real>        _ns;
         Real                _Npar;
         vector<Spectrum>    _specs;
+        vector<Real>        _Ss, _Ss_site;
+        vector<Real>        _ps;
+
+        // Expectation values of the MPOs
+        map<string,MPO>     _mpos;
+        map<string,ITensor> _mpo_envs;
+        map<string,Cplx>    _mpo_vals;
+        int                 _env_lim=0, _last_ha=0;     // the environments contain the sites _env_lim,...,N
+
+        void extend_mpo_envs (int j);
 };
 
 template <typename SitesType>
@@ -58,42 +92,71 @@ void TDVPObserver<SitesType> :: measure (const Args& args)
     auto energy = args.getReal("Energy",0);
 
     if (b != N)
+    {
         _specs.at(b) = spectrum();
+        _Ss.at(b) = EntangEntropy (_specs.at(b));
+    }
 
     int oc = orthoCenter(psi());
     int nc = args.getInt("NumCenter");
     // measure during the second half of sweep
     if (oc == N || ha == 2)
     {
-        // Density
-        ITensor n_op = noPrime (psi().A(oc) * _sites.op("N",oc), "Site");
-
-        n_op *= dag(psi().A(oc));
-        Real ni = real(eltC(n_op));
-        cout << "\t*den " << oc << " " << ni << endl;
+        // Density; on the charge site from the weights of the charge states
+        Real ni = 0.;
+        vector<Real> ps;
+        if (oc == _charge_site)
+        {
+            ps = charge_weights (psi()(oc), _sites(oc));
+            for(int i = 1; i <= ps.size(); i++)
+                ni += _sites.charge(i) * ps.at(i-1);
+            _ps = ps;
+        }
+        else
+        {
+            ITensor n_op = noPrime (psi().A(oc) * _sites.op("N",oc), "Site");
+            n_op *= dag(psi().A(oc));
+            ni = real(eltC(n_op));
+        }
         _ns.at(oc-1) = ni;
 
         // Entanglement entropy
         Real S = EntangEntropy (spectrum());
-        cout << "\t*entS " << oc << " " << S << endl;
+        _Ss_site.at(oc-1) = S;
 
-        if (oc == _charge_site)
+        if (_print)
         {
-            auto denmat = psi()(oc) * dag(prime(psi()(oc),"Site"));
-            denmat.takeReal();
-            auto [Q,D] = diagHermitian (denmat);
-            auto ii = denmat.inds()(1);
-            int maxOcc = _sites.maxOcc();
-            for(int i = 1; i <= dim(ii); i++)
-                cout << "\t*nC " << i-maxOcc-1 << " " << elt (denmat,i,i) << endl;
+            cout << "\t*den " << oc << " " << ni << endl;
+            cout << "\t*entS " << oc << " " << S << endl;
+            for(int i = 1; i <= ps.size(); i++)
+                cout << "\t*nC " << _sites.charge(i) << " " << ps.at(i-1) << endl;
         }
     }
 
-    // At the end of a sweep
-    if (oc == 1 && ha == 2 && b == 1)
+    // The sites right of the center are final in the right-to-left half sweep
+    int lo = args.getInt("ActiveFirst",1);
+    bool sweep_end = (oc == lo && ha == 2 && b == lo);
+    if (ha == 2 && _mpos.size() > 0)
     {
-        for(int i = 1; i < N; i++)
-            cout << "\t*m " << i << " " << dim(rightLinkIndex (psi(), i)) << endl;
+        if (_last_ha != 2)
+        {
+            _env_lim = N+1;
+            for(auto const& [name, mpo] : _mpos)
+                _mpo_envs[name] = ITensor(1.);
+        }
+        extend_mpo_envs (sweep_end ? 1 : oc+1);
+        if (sweep_end)
+            for(auto const& [name, E] : _mpo_envs)
+                _mpo_vals[name] = eltC(E);
+    }
+    _last_ha = ha;
+
+    // At the end of a sweep; the sweep ends at the first site of the active window
+    if (sweep_end)
+    {
+        if (_print)
+            for(int i = 1; i < N; i++)
+                cout << "\t*m " << i << " " << dim(rightLinkIndex (psi(), i)) << endl;
 
         if (_write)
         {
@@ -102,4 +165,22 @@ void TDVPObserver<SitesType> :: measure (const Args& args)
         }
     }
 }
+
+// Extend the environments of the MPOs to the sites j,...,N
+template <typename SitesType>
+void TDVPObserver<SitesType> :: extend_mpo_envs (int j)
+{
+    auto const& psi_ = psi();
+    for(; _env_lim > j; _env_lim--)
+    {
+        int i = _env_lim-1;
+        auto bra = dag(prime(psi_(i)));
+        for(auto& [name, E] : _mpo_envs)
+        {
+            E *= psi_(i);
+            E *= _mpos.at(name)(i);
+            E *= bra;
+        }
+    }
+}
 #endif
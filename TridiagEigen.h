@@ -0,0 +1,102 @@
+#ifndef __TRIDIAGEIGEN_H_CMC__
+#define __TRIDIAGEIGEN_H_CMC__
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "itensor/all.h"
+using namespace itensor;
+using namespace std;
+
+// Eigensolvers for real symmetric tridiagonal matrices
+//   H(i,i) = d[i],  H(i,i+1) = H(i+1,i) = e[i]   (0-index)
+// Only the rows <rows> (0-index) of the eigenvector matrix are returned, so that the memory is O(L * rows.size())
+// instead of O(L^2). The eigenvalues are in descending order, the same as diagHermitian.
+
+extern "C"
+{
+void dstemr_ (char* jobz, char* range, int* n, double* d, double* e, double* vl, double* vu, int* il, int* iu,
+              int* m, double* w, double* z, int* ldz, int* nzc, int* isuppz, int* tryrac,
+              double* work, int* lwork, int* iwork, int* liwork, int* info);
+}
+
+// MRRR (LAPACK dstemr). The eigenvectors are computed in chunks of <chunk> columns,
+// and only the requested rows are kept from each chunk.
+// Return: eigenvalues, U(r,k) = <rows[r]|k>
+tuple<Vector,Matrix>
+tridiag_eigen_MRRR (const vector<Real>& d, const vector<Real>& e, const vector<int>& rows, int chunk=256)
+{
+    int L = d.size();
+    mycheck (e.size() == max(L-1,0), "size not match");
+    Vector ens (L);
+    Matrix U (rows.size(), L);
+    if (L == 0) return {ens, U};
+
+    char jobz = 'V', range = 'I';
+    double vl = 0., vu = 0.;
+    int n = L, ldz = L, nzc = L, tryrac = 1, info = 0;
+    vector<int> isuppz (2*L);
+
+    // Workspace query
+    int lwork = -1, liwork = -1, m = 0, il = 1, iu = 1;
+    double work_q = 0.;
+    int iwork_q = 0;
+    {
+        auto dd = d;
+        auto ee = e;  ee.resize (L, 0.);
+        vector<double> w (L), z (L);
+        dstemr_ (&jobz, &range, &n, dd.data(), ee.data(), &vl, &vu, &il, &iu, &m, w.data(), z.data(), &ldz, &nzc,
+                 isuppz.data(), &tryrac, &work_q, &lwork, &iwork_q, &liwork, &info);
+    }
+    lwork = int(work_q);
+    liwork = iwork_q;
+    vector<double> work (lwork);
+    vector<int> iwork (liwork);
+
+    // dstemr gives the eigenvalues in ascending order; the k-th lowest is put in column L-1-k
+    vector<double> w (L), z ((size_t)L*chunk);
+    for(il = 1; il <= L; il += chunk)
+    {
+        iu = min (il+chunk-1, L);
+        auto dd = d;
+        auto ee = e;  ee.resize (L, 0.);
+        dstemr_ (&jobz, &range, &n, dd.data(), ee.data(), &vl, &vu, &il, &iu, &m, w.data(), z.data(), &ldz, &nzc,
+                 isuppz.data(), &tryrac, work.data(), &lwork, iwork.data(), &liwork, &info);
+        mycheck (info == 0, "dstemr failed, info = "+to_string(info));
+        mycheck (m == iu-il+1, "dstemr returned wrong number of eigenpairs");
+        for(int j = 0; j < m; j++)
+        {
+            int k = L - (il-1+j) - 1;
+            ens(k) = w.at(j);
+            for(int r = 0; r < rows.size(); r++)
+                U(r,k) = z.at ((size_t)j*L + rows.at(r));
+        }
+    }
+    return {ens, U};
+}
+
+// Uniform chain with open boundary: d[i] = a, e[i] = b
+//   E_q = a + 2b cos(q pi/(L+1)),  <i|q> = sqrt(2/(L+1)) sin(i q pi/(L+1)),  q = 1,...,L
+tuple<Vector,Matrix>
+tridiag_eigen_uniform (int L, Real a, Real b, const vector<int>& rows)
+{
+    Vector ens (L);
+    Matrix U (rows.size(), L);
+    vector<pair<Real,int>> eq;
+    for(int q = 1; q <= L; q++)
+        eq.emplace_back (a + 2.*b*cos (q*M_PI/(L+1)), q);
+    std::sort (eq.begin(), eq.end(), [] (const auto& p1, const auto& p2) { return p1.first > p2.first; });
+
+    Real fac = sqrt (2./(L+1));
+    for(int k = 0; k < L; k++)
+    {
+        auto [en, q] = eq.at(k);
+        ens(k) = en;
+        for(int r = 0; r < rows.size(); r++)
+        {
+            int i = rows.at(r) + 1;
+            U(r,k) = fac * sin (i*q*M_PI/(L+1));
+        }
+    }
+    return {ens, U};
+}
+#endif
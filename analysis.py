@@ -1,10 +1,11 @@
 import pylab as pl
 from collections import OrderedDict
-import sys, glob
+import sys, glob, os
 from math import pi, acos
 import plotsetting as ps
 import numpy as np
 import fitfun as ff
+import obsstore
 import matplotlib.colors as colors
 import cmasher as cmr
 import fitfun as ff
@@ -54,7 +55,10 @@ def get_hop_t (fname):
                 ts[L_lead+L_device] = t
     return ts
 
+# fname: the output file, or the directory of the binary observable store (obs_store)
 def get_data (fname):
+    if os.path.isdir (fname):
+        return obsstore.get_data (fname)
     #dmrgdir = get_para (fname, 'input_dir', str)
     #dmrgfile = glob.glob ('../gs/*.out')[0]
     L_lead = get_para (fname, 'L_lead', int)
@@ -84,6 +88,11 @@ def get_data (fname):
                 jR = float(tmp[-1]) * 2*pi * t_lead
                 jLs[step-1] = jL
                 jRs[step-1] = jR
+            elif line.startswith('I L/R continuity ='):
+                # Estimated from the lead charges, for the step before
+                tmp = line.split()
+                jLs[int(tmp[-3])-1] = float(tmp[-2]) * 2*pi * t_lead
+                jRs[int(tmp[-3])-1] = float(tmp[-1]) * 2*pi * t_lead
             elif line.startswith('*den '):
                 tmp = line.split()
                 i = int(tmp[1])
@@ -36,7 +36,12 @@ denmatSumDecomp(std::vector<MPS> const& psis,
 
 	auto [cmb,mid] = combiner(std::move(cinds));
 
-	if(dim(mid) <= dim(commonIndex(U1,S1)))
+	// Frozen bond (outside the active window): no new basis
+	if(args.getBool("Frozen",false))
+		{
+		res.ref(b) = U1;
+		}
+	else if(dim(mid) <= dim(commonIndex(U1,S1)))
 		{
 		res.ref(b) = U1;
 		if(!quiet)
@@ -125,6 +130,11 @@ addBasisWorker(std::vector<MPS> const& psis,
 	int N = length(res);
 	int nt = psis.size()+1;
 
+	// Only the bonds inside the active window [lo,hi] are expanded
+	const int lo = args.getInt("ActiveFirst",1);
+	const int hi = args.getInt("ActiveLast",N);
+	auto args_b = args;
+
 	if(dir == Fromleft)
 		{
 		if(orthoCenter(res) != 1)
@@ -145,7 +155,8 @@ addBasisWorker(std::vector<MPS> const& psis,
 
 		for(int b = 1; b < N ; ++b)
 			{
-			denmatSumDecomp(psis,res,Bs,b,Fromleft,args);
+			args_b.add("Frozen",b < lo || b >= hi);
+			denmatSumDecomp(psis,res,Bs,b,Fromleft,args_b);
 			}
 
 		res.Aref(N) = Bs.front();
@@ -170,7 +181,8 @@ addBasisWorker(std::vector<MPS> const& psis,
 
 		for(int b = N; b > 1 ; --b)
 			{
-			denmatSumDecomp(psis,res,Bs,b,Fromright,args);
+			args_b.add("Frozen",b-1 < lo || b-1 >= hi);
+			denmatSumDecomp(psis,res,Bs,b,Fromright,args_b);
 			}
 
 		res.Aref(1) = Bs.front();
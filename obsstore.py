@@ -0,0 +1,54 @@
+import os
+from math import pi
+import numpy as np
+
+# Reader of the binary observable store written by ObsStore.h (obs_store in the input file)
+
+def read_meta (dirname):
+    meta, cols = {}, {}
+    with open(os.path.join (dirname, 'meta.txt')) as f:
+        for line in f:
+            tmp = line.split()
+            if tmp[0] == 'column':
+                cols[tmp[1]] = int(tmp[2])
+            else:
+                meta[tmp[0]] = tmp[1]
+    return meta, cols
+
+def get_column (dirname, name, ncols):
+    fname = os.path.join (dirname, name+'.bin')
+    nrows = os.path.getsize (fname) // (8*ncols)
+    if nrows == 0:
+        return np.full ((0,ncols), np.nan)
+    return np.memmap (fname, dtype=np.float64, mode='r', shape=(nrows,ncols))
+
+# Rows padded with NaN to Nstep
+def pad_rows (data, Nstep):
+    if len(data) >= Nstep:
+        return data[:Nstep]
+    re = np.full ((Nstep,np.shape(data)[1]), np.nan)
+    re[:len(data)] = data
+    return re
+
+# The same arrays as get_data in analysis.py
+def get_data (dirname):
+    meta, cols = read_meta (dirname)
+    N = int(meta['N'])
+    t_lead = float(meta['t_lead'])
+    data = {name: get_column (dirname, name, n) for name, n in cols.items()}
+
+    Nstep = len(data['den'])
+    L = N-1
+    ns = data['den']
+    Ss = data['entS']
+    dims = data['m']
+    nCs = data['nC']
+    I = pad_rows (data['I'], Nstep)
+    jLs = I[:,0] * 2*pi * t_lead
+    jRs = I[:,1] * 2*pi * t_lead
+    return Nstep, L, jLs, jRs, ns, Ss, dims, nCs
+
+# Wall time of every step
+def get_step_times (dirname):
+    meta, cols = read_meta (dirname)
+    return get_column (dirname, 'step_time', cols['step_time'])[:,0]
@@ -16,12 +16,30 @@ Timers timer;
 #include "ReadWriteFile.h"
 #include "OneParticleBasis.h"
 #include "BdGBasis.h"
+#include "MPOCache.h"
+#include "Benchmark.h"
+#include "OrbOrder.h"
+#include "Reorder.h"
+#include "LogLeadBasis.h"
+#include "LeadReduction.h"
+#include "ActiveWindow.h"
+#include "NaturalOrbitals.h"
+#include "HybridLead.h"
+#include "Lindblad.h"
+#include "ChargeWindow.h"
+#include "BatchExpect.h"
+#include "ContinuityCurrent.h"
+#include "Correlation.h"
+#include "MeasureQueue.h"
+#include "ObsStore.h"
 using namespace itensor;
 using namespace std;
 
 struct Para
 {
     Real Ec=0., Ng=0., Delta=0., EJ=0., tcL=0., tcR=0.;
+    // Hybridization sums of the dropped lead orbitals (LeadReduction.h); the contact energy shifts are tc^2 * sig
+    Real sigL=0., sigR=0.;
 
     void write (ostream& s) const
     {
@@ -42,6 +60,41 @@ struct Para
         iut::read(s,Delta);
         iut::read(s,EJ);
     }
+
+    // Written after the end of the old checkpoint format, from checkpoint version 2
+    void write_ext (ostream& s) const
+    {
+        iut::write(s,sigL);
+        iut::write(s,sigR);
+    }
+
+    void read_ext (istream& s)
+    {
+        iut::read(s,sigL);
+        iut::read(s,sigR);
+    }
+};
+
+// Checkpoints of version 1 end after to_loc; later versions append the version number and the new fields,
+// so that the old checkpoints can still be read
+const int checkpoint_version = 2;
+
+// Linear ramps of Ng, tcL and tcR from their initial values to the final values in time ramp_time
+struct Ramp
+{
+    Real time=0., Ng=0., tcL=0., tcR=0.;
+
+    bool on () const { return time > 0.; }
+
+    Para at (const Para& para0, Real t) const
+    {
+        Real f = min (t / time, 1.);
+        Para para = para0;
+        para.Ng  = para0.Ng  + f * (Ng  - para0.Ng);
+        para.tcL = para0.tcL + f * (tcL - para0.tcL);
+        para.tcR = para0.tcR + f * (tcR - para0.tcR);
+        return para;
+    }
 };
 
 void writeAll (const string& filename,
@@ -60,6 +113,8 @@ void writeAll (const string& filename,
     para.write (ofs);
     iut::write (ofs, to_glob);
     iut::write (ofs, to_loc);
+    iut::write (ofs, checkpoint_version);
+    para.write_ext (ofs);
 }
 
 void readAll (const string& filename,
@@ -78,6 +133,12 @@ void readAll (const string& filename,
     para.read (ifs);
     iut::read (ifs, to_glob);
     iut::read (ifs, to_loc);
+    int version = 1;
+    if (ifs.peek() != EOF)
+        iut::read (ifs, version);
+    mycheck (version <= checkpoint_version, "Checkpoint version "+to_string(version)+" is newer than this program");
+    if (version >= 2)
+        para.read_ext (ifs);
 }
 
 void print_orbs (const vector<SortInfo>& orbs)
@@ -91,10 +152,11 @@ void print_orbs (const vector<SortInfo>& orbs)
 }
 
 template <typename Basis1, typename Basis2, typename SiteType>
-MPO get_current_mpo (const SiteType& sites, const Basis1& basis1, const Basis2& basis2, int i1, int i2, const ToGlobDict& to_glob)
+MPO get_current_mpo (const SiteType& sites, const Basis1& basis1, const Basis2& basis2, int i1, int i2, const ToGlobDict& to_glob,
+                     Real max_discard=0., Real coef=1.)
 {
     AutoMPO ampo (sites);
-    add_CdagC (ampo, basis1, basis2, i1, i2, 1., to_glob);
+    add_CdagC (ampo, basis1, basis2, i1, i2, coef, to_glob, max_discard);
     auto mpo = toMPO (ampo);
     return mpo;
 }
@@ -105,6 +167,69 @@ inline Real get_current (const MPO& JMPO, const MPS& psi)
     return -2. * imag(J);
 }
 
+// Make SiteSet for the orbital dictionary
+template <typename BasisS>
+MixedBasis make_sites (const ToGlobDict& to_glob, const BasisS& scatterer, const Args& args_basis)
+{
+    int N = to_glob.size();
+    int charge_site = to_glob.at (PartC(),1);
+    // Find the global indices for the scatterer sites
+    vector<int> scatter_sites;
+    for(int i = 1; i <= scatterer.size(); i++)
+    {
+        scatter_sites.push_back (to_glob.at (PartS(),i));
+    }
+    return MixedBasis (N, scatter_sites, charge_site, args_basis);
+}
+
+// Short time evolution with the orbital ordering <info>.
+// Return the maximal bond dimension and the wall time of every step.
+template <typename BasisL, typename BasisR, typename BasisC>
+vector<pair<int,Real>>
+probe_growth (const vector<SortInfo>& info, const BasisL& leadL, const BasisR& leadR, const BdGBasis& scatterer, const BasisC& charge,
+              const Para& para, const Args& args_basis, Real muL, Real muR, int maxCharge,
+              int nsteps, Real dt, const Sweeps& sweeps, Real hpsi_cutoff, int hpsi_maxdim,
+              const Args& args_expansion, const Args& args_tdvp)
+{
+    auto [to_glob, to_loc] = make_orb_dicts (info);
+    auto sites = make_sites (to_glob, scatterer, args_basis);
+    auto H = toMPO (get_ampo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob));
+    cout << "Probe MPO dim = " << maxLinkDim(H) << endl;
+    auto psi = get_initial_state (leadL, leadR, scatterer, sites, muL, muR, para, maxCharge, to_glob);
+    psi.position(1);
+    LocalMPO PH (H, args_tdvp);
+    vector<pair<int,Real>> growth;
+    for(int step = 1; step <= nsteps; step++)
+    {
+        cpu_time step_time;
+        addBasis (psi, H, hpsi_cutoff, hpsi_maxdim, args_expansion);
+        PH.reset();
+        TDVPWorker (psi, PH, 1_i*dt, sweeps, args_tdvp);
+        growth.emplace_back (maxLinkDim(psi), step_time.sincemark().wall);
+    }
+    return growth;
+}
+
+void print_probe (const string& name, const vector<pair<int,Real>>& growth)
+{
+    cout << "Probe " << name << ": step, max dim, time (s)" << endl;
+    for(int i = 0; i < growth.size(); i++)
+        cout << "\t" << i+1 << " " << growth[i].first << " " << growth[i].second << endl;
+}
+
+template <typename BasisL, typename BasisR, typename BasisC>
+int probe_max_dim (const vector<SortInfo>& info, const BasisL& leadL, const BasisR& leadR, const BdGBasis& scatterer, const BasisC& charge,
+                   const Para& para, const Args& args_basis, Real muL, Real muR, int maxCharge,
+                   int nsteps, Real dt, const Sweeps& sweeps, Real hpsi_cutoff, int hpsi_maxdim,
+                   const Args& args_expansion, const Args& args_tdvp)
+{
+    int maxdim = 1;
+    for(auto [m, t] : probe_growth (info, leadL, leadR, scatterer, charge, para, args_basis, muL, muR, maxCharge,
+                                    nsteps, dt, sweeps, hpsi_cutoff, hpsi_maxdim, args_expansion, args_tdvp))
+        maxdim = max (maxdim, m);
+    return maxdim;
+}
+
 int main(int argc, char* argv[])
 {
     string infile = argv[1];
@@ -128,6 +253,35 @@ int main(int argc, char* argv[])
     auto EJ         = input.getReal("EJ");
     auto damp_decay_length = input.getInt("damp_decay_length",0);
     auto maxCharge  = input.getInt("maxCharge");
+    // Number of BdG modes checked after the diagonalization; -1 for the full dense check
+    auto BdG_verify_samples = input.getInt("BdG_verify_samples",10);
+    // Eigensolver for the leads: Dense, Tridiagonal, Analytic or Auto
+    auto lead_solver = input.getString("lead_solver","Dense");
+    // Scatterer representation: SC (BdG quasiparticles) or real_space (sites, with explicit hopping and pairing)
+    auto scatter_basis = input.getString("scatter_basis","SC");
+    // Number of time steps of the probe run comparing both scatterer representations; 0 for no probe
+    auto scatter_probe_steps = input.getInt("scatter_probe_steps",0);
+    // Lead discretization: chain (all modes of the L_lead chain), wilson (binned modes of a wilson_L_fine chain)
+    // or hybrid (hybrid_n_real sites next to the device in real space, the modes of the rest)
+    auto lead_basis     = input.getString("lead_basis","chain");
+    auto hybrid_n_real  = input.getInt("hybrid_n_real",2);
+    // Number of time steps of the probe run comparing chain and hybrid leads; 0 for no probe
+    auto lead_bench_steps = input.getInt("lead_bench_steps",0);
+    auto wilson_L_fine  = input.getInt("wilson_L_fine",1000);
+    auto wilson_Lambda  = input.getReal("wilson_Lambda",2.);
+    auto wilson_nlog    = input.getInt("wilson_nlog",6);
+    auto wilson_nwindow = input.getInt("wilson_nwindow",10);
+    // Drop the lead orbitals with |en - mu_bias| > drop_Ecut and perturbative admixture < drop_eps
+    auto drop_inert = input.getYesNo("drop_inert",false);
+    auto drop_Ecut  = input.getReal("drop_Ecut",1.);
+    auto drop_eps   = input.getReal("drop_eps",1e-4);
+    // Freeze the sites whose density and bond entropies do not change (see ActiveWindow.h)
+    auto active_window  = input.getYesNo("active_window",false);
+    auto active_tol_den = input.getReal("active_tol_den",1e-8);
+    auto active_tol_S   = input.getReal("active_tol_S",1e-8);
+    auto active_margin  = input.getInt("active_margin",2);
+    // Rotate the leads to their natural orbitals every natorb_interval steps (0 for never)
+    auto natorb_interval = input.getInt("natorb_interval",0);
 
     auto dt            = input.getReal("dt");
     auto time_steps    = input.getInt("time_steps");
@@ -157,6 +311,61 @@ int main(int argc, char* argv[])
     auto read          = input.getYesNo("read",false);
     auto read_dir      = input.getString("read_dir",".");
     auto read_file     = input.getString("read_file","");
+    // Directory of the Hamiltonian MPO cache; empty to disable
+    auto cache_dir     = input.getString("cache_dir","");
+
+    // Time-dependent protocol; no ramp if ramp_time = 0
+    Ramp ramp;
+    ramp.time          = input.getReal("ramp_time",0.);
+    ramp.Ng            = input.getReal("Ng_final",Ng);
+    ramp.tcL           = input.getReal("t_contactL_final",t_contactL);
+    ramp.tcR           = input.getReal("t_contactR_final",t_contactR);
+
+    // Evolve with the Hamiltonian split into diagonal, contact and charging MPOs (lazily summed).
+    // Off by default: no speedup over the single MPO has been measured; check with benchmark_step first
+    auto H_decomposed  = input.getYesNo("H_decomposed",false);
+    // Compare the effective-Hamiltonian cost of the split and the single MPO at this step; 0 for no benchmark
+    auto benchmark_step = input.getInt("benchmark_step",0);
+
+    // Error bound of the terms dropped from the current MPOs
+    auto current_discard = input.getReal("current_discard",0.);
+    auto current_profile = input.getInt("current_profile",0);
+    // Currents from the MPOs (mpo) or from the lead charges (continuity), checked against the MPOs every current_check_interval steps
+    auto current_method         = input.getString("current_method","mpo");
+    auto current_check_interval = input.getInt("current_check_interval",10);
+    auto expect_threads  = input.getInt("expect_threads",1);
+    // Write the correlation matrices <Cdag_i C_j> and <C_i C_j> to corr_file every corr_interval steps; 0 for never
+    auto corr_interval = input.getInt("corr_interval",0);
+    auto corr_file     = input.getString("corr_file","corr.dat");
+    // Run the measurements above in a worker thread, overlapping with the next time steps.
+    // Off by default: the jobs create no new indices, but the rest of ITensor is not guaranteed to be thread-safe
+    auto async_measure = input.getYesNo("async_measure",false);
+    // Directory of the binary observable store (ObsStore.h); empty to disable. print_obs = no drops the per-site output.
+    auto obs_store     = input.getString("obs_store","");
+    auto print_obs     = input.getYesNo("print_obs",true);
+
+    // Orbital ordering: energy, fiedler, anneal, or probe (the one with the lowest bond dimension in a short run)
+    auto orb_order        = input.getString("orb_order","energy");
+    auto orb_order_time   = input.getReal("orb_order_time",10.);
+    auto orb_anneal_steps = input.getInt("orb_anneal_steps",100000);
+    auto orb_probe_steps  = input.getInt("orb_probe_steps",3);
+
+    // Move the charge site during the evolution when the bonds next to it saturate
+    auto reorder_charge = input.getYesNo("reorder_charge",false);
+    auto reorder_frac   = input.getReal("reorder_frac",0.9);
+    auto reorder_window = input.getInt("reorder_window",4);
+
+    // Adapt the charge states on the charge site within [-maxCharge,maxCharge]: start with charge_window_init states
+    // on each side of the charging-energy optimum, grow an edge above charge_window_grow and drop it below charge_window_shrink
+    auto charge_window        = input.getYesNo("charge_window",false);
+    auto charge_window_init   = input.getInt("charge_window_init",1);
+    auto charge_window_grow   = input.getReal("charge_window_grow",1e-6);
+    auto charge_window_shrink = input.getReal("charge_window_shrink",1e-9);
+
+    // Open leads: evolve the vectorized density matrix, with the lead orbitals coupled to reservoirs at mu_biasL/R
+    auto lindblad       = input.getYesNo("lindblad",false);
+    auto lindblad_gamma = input.getReal("lindblad_gamma",0.1);
+    auto lindblad_T     = input.getReal("lindblad_T",0.);
 
     auto sweeps        = iut::Read_sweeps (infile, "sweeps");
 
@@ -169,12 +378,21 @@ int main(int argc, char* argv[])
     auto sites = MixedBasis();
     Para para;
     Args args_basis;
+    ParamMPO H_param;
+    vector<MPO> Hset;
+
+    ChargeWindow cwin;
 
     ToGlobDict to_glob;
     ToLocDict to_loc;
     OneParticleBasis leadL, leadR, charge;
     BdGBasis scatterer;
 
+    Args args_tdvp_expansion = {"Cutoff",globExpanCutoff, "Method","DensityMatrix",
+                                "KrylovOrd",globExpanKrylovDim, "DoNormalize",true, "Quiet",true};
+    Args args_tdvp  = {"Quiet",true,"NumCenter",NumCenter,"DoNormalize",true,"Truncate",Truncate,
+                       "UseSVD",UseSVD,"SVDmethod",SVDmethod,"WriteDim",WriteDim,"mixNumCenter",mixNumCenter};
+
     // -- Initialization --
     if (!read)
     {
@@ -182,43 +400,222 @@ int main(int argc, char* argv[])
         Real damp_fac = (damp_decay_length == 0 ? 1. : exp(-1./damp_decay_length));
         // Create bases for the leads
         cout << "H left lead" << endl;
-        leadL = OneParticleBasis ("L", L_lead, t_lead, mu_leadL, damp_fac, true, true);
-        cout << "H right lead" << endl;
-        leadR = OneParticleBasis ("R", L_lead, t_lead, mu_leadR, damp_fac, false, true);
+        // Only the two sites at each end are needed, for the contact hoppings and the currents,
+        // and current_profile+1 sites for the current profiles
+        vector<int> lead_sites = {1, 2, -2, -1};
+        for(int i = 3; i <= current_profile+1; i++)
+        {
+            lead_sites.push_back (i);
+            lead_sites.push_back (-i);
+        }
+        if (lead_basis == "hybrid")
+        {
+            leadL = hybrid_lead ("L", L_lead, t_lead, mu_leadL, damp_fac, true, true, hybrid_n_real, lead_sites);
+            cout << "H right lead" << endl;
+            leadR = hybrid_lead ("R", L_lead, t_lead, mu_leadR, damp_fac, false, false, hybrid_n_real, lead_sites);
+        }
+        else if (lead_basis == "wilson")
+        {
+            Real lo = min (mu_biasL, mu_biasR),
+                 hi = max (mu_biasL, mu_biasR);
+            leadL = log_discretized_lead ("L", wilson_L_fine, t_lead, mu_leadL, -1, lead_sites, lo, hi, wilson_Lambda, wilson_nlog, wilson_nwindow);
+            cout << "H right lead" << endl;
+            leadR = log_discretized_lead ("R", wilson_L_fine, t_lead, mu_leadR, 1, lead_sites, lo, hi, wilson_Lambda, wilson_nlog, wilson_nwindow);
+        }
+        else
+        {
+            mycheck (lead_basis == "chain", "Unknown lead_basis: "+lead_basis);
+            leadL = OneParticleBasis ("L", L_lead, t_lead, mu_leadL, damp_fac, true, true, lead_solver, lead_sites);
+            cout << "H right lead" << endl;
+            leadR = OneParticleBasis ("R", L_lead, t_lead, mu_leadR, damp_fac, false, true, lead_solver, lead_sites);
+        }
         // Create basis for scatterer
         cout << "H dev" << endl;
-        scatterer = BdGBasis ("S", L_device, t_device, mu_device, Delta);
+        if (scatter_basis == "real_space")
+            scatterer = BdGBasis::real_space ("S", L_device, t_device, mu_device, Delta);
+        else
+        {
+            mycheck (scatter_basis == "SC", "Unknown scatter_basis: "+scatter_basis);
+            scatterer = BdGBasis ("S", L_device, t_device, mu_device, Delta, BdG_verify_samples);
+        }
         // Create basis for the charge site
         charge = OneParticleBasis ("C", 1);
 
+        para.Ec = Ec;   para.Ng = Ng;   para.Delta = Delta;  para.EJ = EJ;  para.tcL = t_contactL;  para.tcR = t_contactR;
+
+        // Remove the inert lead orbitals. The contact sites are the right end of L and the left end of R.
+        if (drop_inert)
+        {
+            // The far modes of a hybrid lead have no weight on the contact site, so all of them would be dropped
+            mycheck (lead_basis != "hybrid", "drop_inert needs the contact weights of the lead modes; not for hybrid leads");
+            auto redL = find_inert_orbitals (leadL, leadL.n_sites(), t_contactL, mu_biasL, drop_Ecut, drop_eps);
+            auto redR = find_inert_orbitals (leadR, 1, t_contactR, mu_biasR, drop_Ecut, drop_eps);
+            print_reduction ("L", redL, t_contactL);
+            print_reduction ("R", redR, t_contactR);
+            leadL = leadL.sub_basis (redL.kept);
+            leadR = leadR.sub_basis (redR.kept);
+            para.sigL = redL.sigma;
+            para.sigR = redR.sigma;
+        }
+        auto systype = (EJ == 0. ? "SC_scatter" : "SC_Josephson_scatter");
+        args_basis = {"MaxOcc",maxCharge,"SystemType",systype};
+        if (charge_window)
+        {
+            auto [enC0, enC1, n_even, n_odd] = en_charging_energy (maxCharge, Ec, Ng);
+            cwin = ChargeWindow (min (n_even, n_odd) - charge_window_init, max (n_even, n_odd) + charge_window_init,
+                                 maxCharge, charge_window_grow, charge_window_shrink);
+            args_basis.add ("MinCharge", cwin.lo());
+            args_basis.add ("MaxCharge", cwin.hi());
+            cout << "charge window = " << cwin.lo() << " " << cwin.hi() << endl;
+        }
+
+        // Compare the bond dimension growth and the step time of both scatterer representations
+        if (scatter_probe_steps > 0)
+        {
+            vector<pair<string,BdGBasis>> reprs = {{"SC", BdGBasis ("S", L_device, t_device, mu_device, Delta, BdG_verify_samples)},
+                                                   {"real_space", BdGBasis::real_space ("S", L_device, t_device, mu_device, Delta)}};
+            for(auto const& [name, scat] : reprs)
+            {
+                auto info_i = sort_by_energy_charging (charge, leadL, leadR, scat);
+                auto growth = probe_growth (info_i, leadL, leadR, scat, charge, para, args_basis, mu_biasL, mu_biasR, maxCharge,
+                                            scatter_probe_steps, dt, sweeps, globExpanHpsiCutoff, globExpanHpsiMaxDim,
+                                            args_tdvp_expansion, args_tdvp);
+                print_probe ("scatterer "+name, growth);
+            }
+        }
+
+        // Compare the hybrid leads with the leads fully in the energy basis
+        if (lead_bench_steps > 0)
+        {
+            vector<int> lead_sites = {1, 2, -2, -1};
+            vector<pair<string,pair<OneParticleBasis,OneParticleBasis>>> leads =
+                {{"chain",  {OneParticleBasis ("L", L_lead, t_lead, mu_leadL, damp_fac, true, true, lead_solver, lead_sites),
+                             OneParticleBasis ("R", L_lead, t_lead, mu_leadR, damp_fac, false, true, lead_solver, lead_sites)}},
+                 {"hybrid", {hybrid_lead ("L", L_lead, t_lead, mu_leadL, damp_fac, true, true, hybrid_n_real, lead_sites),
+                             hybrid_lead ("R", L_lead, t_lead, mu_leadR, damp_fac, false, false, hybrid_n_real, lead_sites)}}};
+            for(auto const& [name, LR] : leads)
+            {
+                auto const& [lL, lR] = LR;
+                auto info_i = sort_by_energy_charging (charge, lL, lR, scatterer);
+                auto growth = probe_growth (info_i, lL, lR, scatterer, charge, para, args_basis, mu_biasL, mu_biasR, maxCharge,
+                                            lead_bench_steps, dt, sweeps, globExpanHpsiCutoff, globExpanHpsiMaxDim,
+                                            args_tdvp_expansion, args_tdvp);
+                print_probe ("leads "+name, growth);
+            }
+        }
+
         // Combine and sort all the basis states
         auto info = sort_by_energy_charging (charge, leadL, leadR, scatterer);
+        if (orb_order != "energy")
+        {
+            auto orders = optimize_orbital_order (info, leadL, leadR, scatterer, mu_biasL, mu_biasR, para, orb_order_time, orb_anneal_steps);
+            if (orb_order == "probe")
+            {
+                // Measure the bond dimension of every candidate and take the lowest
+                int best_dim = std::numeric_limits<int>::max();
+                cout << "Orbital ordering probe: name, measured max dim" << endl;
+                for(auto const& [name, info_i] : orders)
+                {
+                    int m = probe_max_dim (info_i, leadL, leadR, scatterer, charge, para, args_basis, mu_biasL, mu_biasR, maxCharge,
+                                           orb_probe_steps, dt, sweeps, globExpanHpsiCutoff, globExpanHpsiMaxDim,
+                                           args_tdvp_expansion, args_tdvp);
+                    cout << "\t" << name << " " << m << endl;
+                    if (m < best_dim)
+                    {
+                        best_dim = m;
+                        info = info_i;
+                    }
+                }
+            }
+            else
+            {
+                bool found = false;
+                for(auto const& [name, info_i] : orders)
+                    if (name == orb_order)
+                    {
+                        info = info_i;
+                        found = true;
+                    }
+                mycheck (found, "Unknown orb_order: "+orb_order);
+            }
+        }
         tie(to_glob, to_loc) = make_orb_dicts (info);
         print_orbs(info);
 
-        // SiteSet
-        int N = to_glob.size();
-        int charge_site = to_glob.at({"C",1});
-        // Find the global indices for the scatterer sites
-        vector<int> scatter_sites;
-        for(int i = 1; i <= scatterer.size(); i++)
-        {
-            scatter_sites.push_back (to_glob.at({"S",i}));
-        }
         // Make SiteSet
-        auto systype = (EJ == 0. ? "SC_scatter" : "SC_Josephson_scatter");
-        args_basis = {"MaxOcc",maxCharge,"SystemType",systype};
-        sites = MixedBasis (N, scatter_sites, charge_site, args_basis);
+        sites = make_sites (to_glob, scatterer, args_basis);
+        int charge_site = to_glob.at (PartC(),1);
         cout << "charge site = " << charge_site << endl;
 
+        // Open leads (Lindblad.h)
+        if (lindblad)
+        {
+            mycheck (!ramp.on() and !H_decomposed, "lindblad does not support ramps and H_decomposed");
+            // The reservoirs use the orbital energies en(k), which are the lead eigenenergies only in the energy basis
+            mycheck (lead_basis != "hybrid" and natorb_interval == 0, "lindblad needs the leads in the energy basis; not for hybrid leads and natorb_interval");
+            auto ampo = get_ampo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob);
+            run_lindblad (ampo, leadL, leadR, scatterer, sites, to_glob, args_basis, para.tcL, para.tcR, mu_biasL, mu_biasR,
+                          lindblad_gamma, lindblad_T, time_steps, dt, sweeps, globExpanHpsiCutoff, globExpanHpsiMaxDim,
+                          globExpanN, globExpanItv, args_tdvp_expansion, args_tdvp);
+            timer.print();
+            return 0;
+        }
+
         // Make Hamiltonian MPO
-        para.Ec = Ec;   para.Ng = Ng;   para.Delta = Delta;  para.EJ = EJ;  para.tcL = t_contactL;  para.tcR = t_contactR;
-        auto ampo = get_ampo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob);
-        H = toMPO (ampo);
+        bool cache_hit = false;
+        string cache_key, cache_file;
+        if (ramp.on())
+        {
+            H_param = get_param_mpo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob);
+            H = H_param.mpo();
+        }
+        else if (cache_dir != "")
+        {
+            vector<pair<string,Real>> real_paras = {{"t_lead",t_lead}, {"t_device",t_device}, {"tcL",para.tcL}, {"tcR",para.tcR},
+                                                    {"mu_leadL",mu_leadL}, {"mu_leadR",mu_leadR}, {"mu_device",mu_device},
+                                                    {"Delta",Delta}, {"Ec",Ec}, {"Ng",Ng}, {"EJ",EJ},
+                                                    {"sigL",para.sigL}, {"sigR",para.sigR}};
+            vector<pair<string,int>> int_paras = {{"L_lead",L_lead}, {"L_device",L_device}, {"damp_decay_length",damp_decay_length},
+                                                  {"maxCharge",maxCharge},
+                                                  {"scatter_real_space",int(scatter_basis == "real_space")},
+                                                  {"min_charge",args_basis.getInt("MinCharge",-maxCharge)},
+                                                  {"max_charge",args_basis.getInt("MaxCharge",maxCharge)}};
+            // Only the Wilson leads depend on the bias window, so that bias scans with the other leads share the cache
+            if (lead_basis == "wilson")
+            {
+                real_paras.insert (real_paras.end(), {{"mu_biasL",mu_biasL}, {"mu_biasR",mu_biasR}, {"wilson_Lambda",wilson_Lambda}});
+                int_paras.insert (int_paras.end(), {{"wilson",1}, {"wilson_L_fine",wilson_L_fine}, {"wilson_nlog",wilson_nlog},
+                                                    {"wilson_nwindow",wilson_nwindow}});
+            }
+            if (lead_basis == "hybrid")
+                int_paras.insert (int_paras.end(), {{"hybrid",1}, {"hybrid_n_real",hybrid_n_real}});
+            cache_key = hamilt_cache_key (real_paras, int_paras, to_loc);
+            cache_file = hamilt_cache_file (cache_dir, cache_key);
+            timer["H cache"].start();
+            cache_hit = read_hamilt_cache (cache_file, cache_key, sites, H, to_glob, to_loc);
+            timer["H cache"].stop();
+            cout << "Hamiltonian cache " << (cache_hit ? "hit: " : "miss: ") << cache_file << endl;
+        }
+        if (!cache_hit and !ramp.on())
+        {
+            auto ampo = get_ampo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob);
+            H = toMPO (ampo);
+            if (cache_dir != "")
+                write_hamilt_cache (cache_file, cache_key, H, to_glob, to_loc);
+        }
         cout << "MPO dim = " << maxLinkDim(H) << endl;
+        if (H_decomposed)
+        {
+            mycheck (!ramp.on(), "Ramps are not supported with H_decomposed");
+            for(auto const& ampo : get_ampo_set_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob))
+            {
+                Hset.push_back (toMPO (ampo));
+                cout << "MPO set dim = " << maxLinkDim(Hset.back()) << endl;
+            }
+        }
 
         // Initialze MPS
-        psi = get_ground_state_BdG_scatter (leadL, leadR, scatterer, sites, mu_biasL, mu_biasR, para, maxCharge, to_glob);
+        psi = get_initial_state (leadL, leadR, scatterer, sites, mu_biasL, mu_biasR, para, maxCharge, to_glob);
         psi.position(1);
 
         // Check initial energy
@@ -226,55 +623,371 @@ int main(int argc, char* argv[])
     }
     else
     {
+        mycheck (!ramp.on(), "Ramps need the bases and cannot restart from a checkpoint");
+        mycheck (!H_decomposed, "H_decomposed needs the bases and cannot restart from a checkpoint");
+        mycheck (!reorder_charge, "reorder_charge needs the bases and cannot restart from a checkpoint");
+        mycheck (natorb_interval == 0, "natorb_interval needs the bases and cannot restart from a checkpoint");
+        mycheck (!lindblad, "lindblad needs the bases and cannot restart from a checkpoint");
+        mycheck (current_profile == 0, "current_profile needs the bases and cannot restart from a checkpoint");
         readAll (read_dir+"/"+read_file, psi, H, para, args_basis, step, to_glob, to_loc);
+        if (charge_window)
+            cwin = ChargeWindow (args_basis.getInt("MinCharge",-maxCharge), args_basis.getInt("MaxCharge",maxCharge),
+                                 maxCharge, charge_window_grow, charge_window_shrink);
         sites = MixedBasis (siteInds(psi), args_basis);
     }
     // -- End of initialization --
 
 
     // -- Observer --
-    auto obs = TDVPObserver (sites, psi, {"charge_site",to_glob.at({"C",1})});
-    // Current MPO
-    auto jmpoL = get_current_mpo (sites, leadL, leadL, -2, -1, to_glob);
-    auto jmpoR = get_current_mpo (sites, leadR, leadR, 1, 2, to_glob);
+    auto obs = TDVPObserver (sites, psi, {"charge_site",to_glob.at({"C",1}),"Print",print_obs});
+    ObsStore store (obs_store, read);
+    if (store.on())
+    {
+        int N = length(psi);
+        store.set_meta ("N", N);
+        store.set_meta ("L_lead", L_lead);
+        store.set_meta ("L_device", L_device);
+        store.set_meta ("t_lead", t_lead);
+        store.set_meta ("maxCharge", maxCharge);
+        store.set_meta ("dt", dt);
+        store.add_column ("den", N);
+        store.add_column ("entS", N);
+        store.add_column ("m", N-1);
+        store.add_column ("nC", 2*maxCharge+1);
+        store.add_column ("I", 2);
+        store.add_column ("step_time", 1);
+    }
+    // Current MPO. The Wilson leads keep only the modes near the bias window, in which the bond inside the lead is only approximate,
+    // so the current is measured at the contact bond, in units of t_lead as the bond currents.
+    mycheck (lead_basis != "wilson" or !ramp.on(), "The contact currents of the Wilson leads do not follow the ramp of the contact hoppings");
+    mycheck (lead_basis != "wilson" or current_profile == 0, "current_profile needs real-space lead bonds; not for the Wilson leads");
+    auto make_current_mpos = [&] ()
+    {
+        if (lead_basis == "wilson")
+            return make_pair (get_current_mpo (sites, leadL, scatterer, -1, 1, to_glob, current_discard, para.tcL/t_lead),
+                              get_current_mpo (sites, scatterer, leadR, -1, 1, to_glob, current_discard, para.tcR/t_lead));
+        return make_pair (get_current_mpo (sites, leadL, leadL, -2, -1, to_glob, current_discard),
+                          get_current_mpo (sites, leadR, leadR, 1, 2, to_glob, current_discard));
+    };
+    MPO jmpoL, jmpoR;
+    tie (jmpoL, jmpoR) = make_current_mpos ();
+    // The same MPOs for the checks of the continuity currents
+    BatchExpect checks;
+    if (current_method == "mpo")
+    {
+        obs.add_mpo ("jL", jmpoL);
+        obs.add_mpo ("jR", jmpoR);
+    }
+    else
+    {
+        mycheck (current_method == "continuity", "Unknown current_method: "+current_method);
+        checks.add ("jL", jmpoL);
+        checks.add ("jR", jmpoR);
+    }
+    // In units of the lead hopping, as the MPO currents
+    auto cont = ContinuityCurrent (dt * t_lead, {"L","R"});
+    // Currents through the first current_profile bonds of each lead, counted from the contact
+    BatchExpect profile;
+    auto set_profile = [&] ()
+    {
+        for(int i = 1; i <= current_profile; i++)
+        {
+            profile.add ("jL"+to_string(i), get_current_mpo (sites, leadL, leadL, -i-1, -i, to_glob, current_discard));
+            profile.add ("jR"+to_string(i), get_current_mpo (sites, leadR, leadR, i, i+1, to_glob, current_discard));
+        }
+    };
+    set_profile ();
+    MeasureQueue measure (async_measure);
+
+    // Active window: the scatterer and the charge site are always active
+    auto pinned_sites = [&to_glob, &scatterer] ()
+    {
+        vector<int> is = {to_glob.at (PartC(),1)};
+        for(int k = 1; k <= scatterer.size(); k++)
+            is.push_back (to_glob.at (PartS(),k));
+        return is;
+    };
+    ActiveWindow window;
+    if (active_window)
+    {
+        mycheck (!read, "active_window needs the bases and cannot restart from a checkpoint");
+        window = ActiveWindow (length(psi), pinned_sites(), active_tol_den, active_tol_S, active_margin);
+    }
+    auto with_window = [&window, active_window] (Args args)
+    {
+        if (active_window)
+        {
+            args.add ("ActiveFirst", window.first());
+            args.add ("ActiveLast", window.last());
+        }
+        return args;
+    };
 
     // -- Time evolution --
     cout << "Start time evolution" << endl;
     cout << sweeps << endl;
     psi.position(1);
     Real en, err;
-    Args args_tdvp_expansion = {"Cutoff",globExpanCutoff, "Method","DensityMatrix",
-                                "KrylovOrd",globExpanKrylovDim, "DoNormalize",true, "Quiet",true};
-    Args args_tdvp  = {"Quiet",true,"NumCenter",NumCenter,"DoNormalize",true,"Truncate",Truncate,
-                       "UseSVD",UseSVD,"SVDmethod",SVDmethod,"WriteDim",WriteDim,"mixNumCenter",mixNumCenter};
     LocalMPO PH (H, args_tdvp);
+    LocalMPOSet PHset;
+    if (H_decomposed)
+        PHset = LocalMPOSet (Hset, args_tdvp);
+
+    // Rebuild everything that depends on the ordering or on the bases
+    auto rebuild_hamilt = [&] ()
+    {
+        if (ramp.on())
+        {
+            H_param = get_param_mpo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, ramp.at (para, step*dt), to_glob);
+            H = H_param.mpo();
+        }
+        else
+            H = toMPO (get_ampo_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob));
+        PH.reset();
+        if (H_decomposed)
+        {
+            Hset.clear();
+            for(auto const& ampo : get_ampo_set_Kitaev_chain (leadL, leadR, scatterer, charge, sites, para, to_glob))
+                Hset.push_back (toMPO (ampo));
+            PHset = LocalMPOSet (Hset, args_tdvp);
+        }
+        tie (jmpoL, jmpoR) = make_current_mpos ();
+        if (current_method == "mpo")
+        {
+            obs.add_mpo ("jL", jmpoL);
+            obs.add_mpo ("jR", jmpoR);
+        }
+        else
+        {
+            checks.add ("jL", jmpoL);
+            checks.add ("jR", jmpoR);
+        }
+        set_profile ();
+    };
+
     while (step <= time_steps)
     {
         cout << "step = " << step << endl;
+        cpu_time step_time;
 
         // Subspace expansion
         if (maxLinkDim(psi) < sweeps.mindim(1) or (step < globExpanN and (step-1) % globExpanItv == 0))
         {
             timer["glob expan"].start();
-            addBasis (psi, H, globExpanHpsiCutoff, globExpanHpsiMaxDim, args_tdvp_expansion);
+            addBasis (psi, H, globExpanHpsiCutoff, globExpanHpsiMaxDim, with_window (args_tdvp_expansion));
             PH.reset();
+            if (H_decomposed)
+                PHset = LocalMPOSet (Hset, args_tdvp);
             timer["glob expan"].stop();
         }
 
+        // Update the time-dependent coefficients at the middle of the time step
+        if (ramp.on())
+        {
+            timer["update H"].start();
+            auto para_t = ramp.at (para, (step-0.5)*dt);
+            if (update_param_mpo (H_param, para_t))
+            {
+                H = H_param.mpo();
+                invalidate_changed_sites (PH, psi, H_param);
+            }
+            cout << "\tNg, tcL, tcR = " << para_t.Ng << " " << para_t.tcL << " " << para_t.tcR << endl;
+            timer["update H"].stop();
+        }
+
+        if (step == benchmark_step and H_decomposed)
+        {
+            LocalMPO PH_bench (H);
+            LocalMPOSet PHset_bench (Hset);
+            benchmark_local_product (psi, PH_bench, PHset_bench, 3, "single MPO", "MPO set");
+        }
+
         // Time evolution
         timer["tdvp"].start();
         //tdvp (psi, H, 1_i*dt, sweeps, obs, args_tdvp);
-        TDVPWorker (psi, PH, 1_i*dt, sweeps, obs, args_tdvp);
+        if (H_decomposed)
+            TDVPWorker (psi, PHset, 1_i*dt, sweeps, obs, with_window (args_tdvp));
+        else
+            TDVPWorker (psi, PH, 1_i*dt, sweeps, obs, with_window (args_tdvp));
         timer["tdvp"].stop();
+        if (active_window)
+        {
+            window.update (obs.ns(), obs.entropies());
+            cout << "\tactive window = " << window.first() << " " << window.last()
+                 << ", frozen fraction = " << window.frozen_fraction() << endl;
+        }
         auto d1 = maxLinkDim(psi);
 
-        // Measure currents by MPO
-        timer["current mps"].start();
-        auto jL = get_current (jmpoL, psi);
-        auto jR = get_current (jmpoR, psi);
-        cout << "\tI L/R = " << jL << " " << jR << endl;
-        timer["current mps"].stop();
+        // Currents, measured by the observer during the last half sweep
+        if (current_method == "mpo")
+        {
+            auto jL = -2. * imag (obs.expect ("jL"));
+            auto jR = -2. * imag (obs.expect ("jR"));
+            cout << "\tI L/R = " << jL << " " << jR << endl;
+            if (store.on())
+                store.write ("I", step, {jL, jR});
+        }
+        // or from the lead charges. As -2 Im <Cdag_i C_i+1> with the hopping -t, the currents count the particles flowing to the left:
+        // I L = dN_L/dt and I R = -dN_R/dt. The estimate is one step behind.
+        else
+        {
+            cont.add (obs.ns(), to_loc);
+            if (cont.ready())
+            {
+                auto [dNL, errL] = cont.rate ("L");
+                auto [dNR, errR] = cont.rate ("R");
+                cout << "\tI L/R continuity = " << step-1 << " " << dNL << " " << -dNR << endl;
+                cout << "\tI L/R continuity error = " << errL << " " << errR << endl;
+                if (store.on())
+                    store.write ("I", step-1, {dNL, -dNR});
+            }
+        }
+
+        // Observables of the sweep
+        if (store.on())
+        {
+            int N = length(psi);
+            vector<Real> ms, nCs (2*maxCharge+1, numeric_limits<Real>::quiet_NaN());
+            for(int i = 1; i < N; i++)
+                ms.push_back (dim (rightLinkIndex (psi,i)));
+            auto const& ps = obs.charge_dist();
+            for(int i = 1; i <= ps.size(); i++)
+                nCs.at (sites.charge(i) + maxCharge) = ps.at(i-1);
+            store.write ("den", step, obs.ns());
+            store.write ("entS", step, obs.site_entropies());
+            store.write ("m", step, ms);
+            store.write ("nC", step, nCs);
+        }
+
+        // Measurements on a copy of psi, in the worker thread with async_measure.
+        // The jobs only contract existing tensors: psi is gauged here, and the MPO checks use BatchExpect instead of innerC,
+        // since new Index objects cannot be created concurrently with the time evolution.
+        bool check = (current_method == "continuity" and current_check_interval > 0 and step % current_check_interval == 0);
+        bool corr = (corr_interval > 0 and step % corr_interval == 0);
+        if (check or current_profile > 0 or corr)
+        {
+            timer["measure"].start();
+            psi.position(1);
+            measure.push ([=, psi = MPS(psi)] ()
+            {
+                ostringstream os;
+                os << scientific << setprecision(14);
+                os << "\tmeasurements of step " << step << endl;
+                if (check)
+                {
+                    auto js = checks.compute (psi);
+                    os << "\tI L/R MPO check = " << step << " " << -2. * imag (js.at("jL")) << " " << -2. * imag (js.at("jR")) << endl;
+                }
+                if (current_profile > 0)
+                {
+                    auto js = profile.compute (psi, expect_threads);
+                    for(string lead : {"L","R"})
+                    {
+                        os << "\tI profile " << lead << " =";
+                        for(int i = 1; i <= current_profile; i++)
+                            os << " " << -2. * imag (js.at ("j"+lead+to_string(i)));
+                        os << endl;
+                    }
+                }
+                // Correlation matrices of all the fermionic sites; the anomalous part within the scatterer
+                if (corr)
+                {
+                    vector<int> js, js_anom;
+                    for(int i = 1; i <= length(psi); i++)
+                        if (is_fermion_site (sites(i)))
+                        {
+                            js.push_back (i);
+                            if (to_loc.at(i).first == "S")
+                                js_anom.push_back (i);
+                        }
+                    auto [rho, kappa] = correlation_matrices (psi, sites, js, js_anom, expect_threads);
+                    ofstream ofs (write_dir+"/"+corr_file, ios::app);
+                    ofs << scientific << setprecision(14);
+                    ofs << "step = " << step << endl;
+                    for(int a = 0; a < js.size(); a++)
+                        for(int b = 0; b < js.size(); b++)
+                            ofs << js[a] << " " << js[b] << " " << rho(a,b).real() << " " << rho(a,b).imag()
+                                << " " << kappa(a,b).real() << " " << kappa(a,b).imag() << endl;
+                }
+                return os.str();
+            });
+            timer["measure"].stop();
+        }
+        measure.print();
+
+        // Rotate the leads to their natural orbitals
+        if (natorb_interval > 0 and step % natorb_interval == 0)
+        {
+            timer["natural orbitals"].start();
+            // The gates are truncated like the first sweep of the evolution
+            Args args_natorb = {"Cutoff",sweeps.cutoff(1),"MaxDim",sweeps.maxdim(1)};
+            bool rotated = rotate_to_natural_orbitals (psi, leadL, sites, to_glob, args_natorb);
+            rotated = rotate_to_natural_orbitals (psi, leadR, sites, to_glob, args_natorb) or rotated;
+            if (rotated)
+            {
+                psi.position(1);
+                rebuild_hamilt ();
+                if (active_window)
+                    window.reset (pinned_sites());
+                cout << "\tH dim = " << maxLinkDim(H) << endl;
+            }
+            timer["natural orbitals"].stop();
+        }
 
+        // Reorder the charge site
+        if (reorder_charge)
+        {
+            int ic = to_glob.at (PartC(),1);
+            int target = charge_site_target (psi, ic, sweeps.maxdim(1), reorder_frac, reorder_window);
+            if (target != ic)
+            {
+                timer["reorder"].start();
+                cout << "\tmove charge site " << ic << " -> " << target << endl;
+                move_site (psi, ic, target, to_glob, to_loc, {"Cutoff",sweeps.cutoff(1),"MaxDim",sweeps.maxdim(1)});
+                psi.position(1);
+                sites = MixedBasis (siteInds(psi), args_basis);
+
+                rebuild_hamilt ();
+                obs.reset_sites (sites, target);
+                if (active_window)
+                    window.reset (pinned_sites());
+                cout << "\tcharge site = " << target << endl;
+                timer["reorder"].stop();
+            }
+        }
+
+        // Adapt the charge states of the charge site
+        if (charge_window and obs.charge_dist().size() > 0)
+        {
+            int old_lo = cwin.lo();
+            if (cwin.update (obs.charge_dist()))
+            {
+                timer["charge window"].start();
+                int ic = to_glob.at (PartC(),1);
+                args_basis.add ("MinCharge", cwin.lo());
+                args_basis.add ("MaxCharge", cwin.hi());
+                auto s_new = SpecialBosonSite ({args_basis,"SiteNumber=",ic}).index();
+                resize_charge_site (psi, ic, s_new, cwin.lo(), old_lo, {"Cutoff",sweeps.cutoff(1),"MaxDim",sweeps.maxdim(1)});
+                psi.position(1);
+                sites = MixedBasis (siteInds(psi), args_basis);
+
+                rebuild_hamilt ();
+                // Open the QN blocks of the new charges on the neighbouring bonds
+                addBasis (psi, H, globExpanHpsiCutoff, globExpanHpsiMaxDim, with_window (args_tdvp_expansion));
+                PH.reset();
+                if (H_decomposed)
+                    PHset = LocalMPOSet (Hset, args_tdvp);
+                obs.reset_sites (sites, ic);
+                cout << "\tcharge window = " << cwin.lo() << " " << cwin.hi() << endl;
+                timer["charge window"].stop();
+            }
+        }
+
+        if (store.on())
+        {
+            store.write ("step_time", step, {step_time.sincemark().wall});
+            store.flush();
+        }
         step++;
         if (write)
         {
@@ -283,6 +996,7 @@ int main(int argc, char* argv[])
             timer["write"].stop();
         }
     }
+    measure.print (true);
     timer.print();
     return 0;
 }
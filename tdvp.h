@@ -164,6 +164,113 @@ vector<bool> reach_max_dim (const MPS& psi, int maxdim)
     return re;
 }
 
+// The same as sweepnext, restricted to the sites lo,...,hi
+inline void
+sweepnext_window(int& b, int& ha, int lo, int hi, int numCenter)
+{
+    const int inc = (ha==1 ? +1 : -1);
+    b += inc;
+    if(b == (ha==1 ? hi+2-numCenter : lo-1))
+        {
+        b -= inc;
+        ++ha;
+        }
+}
+
+// exp(A) of a small dense matrix (row-major, n x n) by scaling and squaring of the Taylor series
+inline std::vector<Cplx>
+expSmallMatrix(std::vector<Cplx> A, int n)
+    {
+    Real nrm = 0.;
+    for(int i = 0; i < n; i++)
+        {
+        Real r = 0.;
+        for(int j = 0; j < n; j++) r += std::abs(A[i*n+j]);
+        nrm = std::max(nrm,r);
+        }
+    int nsq = (nrm > 0.5 ? int(std::ceil(std::log2(nrm/0.5))) : 0);
+    for(auto& a : A) a /= std::pow(2.,nsq);
+
+    auto mult = [n] (const std::vector<Cplx>& X, const std::vector<Cplx>& Y)
+        {
+        std::vector<Cplx> Z (n*n, 0.);
+        for(int i = 0; i < n; i++)
+            for(int k = 0; k < n; k++)
+                for(int j = 0; j < n; j++)
+                    Z[i*n+j] += X[i*n+k] * Y[k*n+j];
+        return Z;
+        };
+    std::vector<Cplx> E (n*n, 0.), term (n*n, 0.);
+    for(int i = 0; i < n; i++) E[i*n+i] = term[i*n+i] = 1.;
+    for(int k = 1; k <= 16; k++)
+        {
+        term = mult(term,A);
+        for(int i = 0; i < n*n; i++)
+            {
+            term[i] /= Real(k);
+            E[i] += term[i];
+            }
+        }
+    for(int s = 0; s < nsq; s++)
+        E = mult(E,E);
+    return E;
+    }
+
+// phi -> exp(tau H) phi by the Arnoldi method, for a generator H which is not Hermitian
+// (applyExp assumes a Hermitian H). Stops when the standard a-posteriori error
+// |phi| h_{m+1,m} |[exp(tau H_m)]_{m,1}| is below ErrGoal, or after MaxIter Krylov vectors.
+template <class LocalOpT>
+void
+applyExpArnoldi(LocalOpT const& H, ITensor& phi, Cplx tau, Args const& args)
+    {
+    const int maxiter = std::max(1,args.getInt("MaxIter",30));
+    const Real errgoal = args.getReal("ErrGoal",1E-12);
+    const Real beta = norm(phi);
+    if(beta == 0.) return;
+
+    std::vector<ITensor> V = {phi/beta};
+    std::vector<Cplx> h ((maxiter+1)*maxiter, 0.);    // Hessenberg matrix, h[i*maxiter+j]
+    std::vector<Cplx> E;
+    int m = 0;
+    for(m = 1; m <= maxiter; m++)
+        {
+        ITensor w;
+        H.product(V.back(),w);
+        for(int k = 0; k < m; k++)
+            {
+            auto hk = eltC(dag(V.at(k))*w);
+            h[k*maxiter+m-1] = hk;
+            w -= hk*V.at(k);
+            }
+        Real hn = norm(w);
+        h[m*maxiter+m-1] = hn;
+
+        std::vector<Cplx> Hm (m*m);
+        for(int i = 0; i < m; i++)
+            for(int j = 0; j < m; j++)
+                Hm[i*m+j] = tau * h[i*maxiter+j];
+        E = expSmallMatrix(Hm,m);
+        if(hn < 1E-14 || beta*hn*std::abs(E[(m-1)*m]) < errgoal || m == maxiter)
+            break;
+        V.push_back(w/hn);
+        }
+
+    phi = beta*E[0]*V.at(0);
+    for(int i = 1; i < m; i++)
+        phi += beta*E[i*m]*V.at(i);
+    }
+
+// exp(tau H) phi; the Arnoldi method is used with the arg NonHermitian
+template <class LocalOpT>
+void
+localExp(LocalOpT const& H, ITensor& phi, Cplx tau, Args const& args)
+    {
+    if(args.getBool("NonHermitian",false))
+        applyExpArnoldi(H,phi,tau,args);
+    else
+        applyExp(H,phi,tau,args);
+    }
+
 template <class LocalOpT>
 Real
 TDVPWorker(MPS & psi,
@@ -191,11 +298,18 @@ TDVPWorker(MPS & psi,
     const int N = length(psi);
     Real energy = NAN;
 
+    // Active window of sites [lo,hi]; the sites outside are frozen and not visited.
+    // The environments of the frozen parts are kept in H and reused.
+    const int lo = args.getInt("ActiveFirst",1);
+    const int hi = args.getInt("ActiveLast",N);
+    if(lo < 1 || hi > N || hi-lo+1 < args.getInt("NumCenter",2))
+        Error("Invalid active window");
+
     auto halfSweep = args.getString("HalfSweep","");
     if (halfSweep == "toLeft")
-        psi.position(N);
+        psi.position(hi);
     else
-        psi.position(1);
+        psi.position(lo);
 
     args.add("DebugLevel",debug_level);
 
@@ -240,7 +354,7 @@ TDVPWorker(MPS & psi,
         // 0, 1 and 2-site wavefunctions
         ITensor phi0,phi1;
         Spectrum spec;
-        for(int b = 1, ha = 1; ha <= 2; )
+        for(int b = lo, ha = 1; ha <= 2; )
         {
             if (halfSweep == "toRight" && ha == 2)
                 continue;
@@ -259,7 +373,7 @@ TDVPWorker(MPS & psi,
             else if(numCenter == 1)
                 phi1 = psi(b);
 
-            applyExp(H,phi1,-t/2,args);
+            localExp(H,phi1,-t/2,args);
 
             if(args.getBool("DoNormalize",true))
                 phi1 /= norm(phi1);
@@ -281,7 +395,7 @@ TDVPWorker(MPS & psi,
                 int maxdim = sweeps.maxdim(sw);
                 if (ha == 1)
                 {
-                    if (numCenter == 2 and b < N-1 and !is_maxdim.at(b) and is_maxdim.at(b+1))
+                    if (numCenter == 2 and b < hi-1 and !is_maxdim.at(b) and is_maxdim.at(b+1))
                     {
                         phi1 = psi(b+1);
                         numCenter = 1;
@@ -290,7 +404,7 @@ TDVPWorker(MPS & psi,
                 }
                 else if (ha == 2)
                 {
-                    if (numCenter == 2 and b > 1 and !is_maxdim.at(b) and is_maxdim.at(b-1))
+                    if (numCenter == 2 and b > lo and !is_maxdim.at(b) and is_maxdim.at(b-1))
                     {
                         phi1 = psi(b);
                         numCenter = 1;
@@ -299,7 +413,7 @@ TDVPWorker(MPS & psi,
             }
 
             // Backward propagation
-            if((ha == 1 && b+numCenter-1 != N) || (ha == 2 && b != 1))
+            if((ha == 1 && b+numCenter-1 != hi) || (ha == 2 && b != lo))
                 {
                 auto b1 = (ha == 1 ? b+1 : b);
  
@@ -321,7 +435,7 @@ TDVPWorker(MPS & psi,
                 H.numCenter(numCenter-1);
                 H.position(b1,psi);
  
-                applyExp(H,phi0,+t/2,args);
+                localExp(H,phi0,+t/2,args);
  
                 if(args.getBool("DoNormalize",true))
                     phi0 /= norm(phi0);
@@ -378,21 +492,21 @@ TDVPWorker(MPS & psi,
                 int maxdim = sweeps.maxdim(sw);
                 if (ha == 1)
                 {
-                    if (numCenter == 1 and b != N and is_maxdim.at(b) and !is_maxdim.at(b+1))
+                    if (numCenter == 1 and b != hi and is_maxdim.at(b) and !is_maxdim.at(b+1))
                     {
                         numCenter = 2;
                     }
                 }
                 else if (ha == 2)
                 {
-                    if (numCenter == 1 and b > 2 and is_maxdim.at(b-1) and !is_maxdim.at(b-2))
+                    if (numCenter == 1 and b > lo+1 and is_maxdim.at(b-1) and !is_maxdim.at(b-2))
                     {
                         numCenter = 2;
                         b -= 1;
                     }
                 }
             }
-            sweepnext(b,ha,N,{"NumCenter=",numCenter});
+            sweepnext_window(b,ha,lo,hi,numCenter);
         } //for loop over b
 
         if(!silent)